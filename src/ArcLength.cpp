@@ -0,0 +1,254 @@
+/************************************************************************
+     File:        ArcLength.cpp
+
+     Comment:     Arc length parameterization of the track
+
+						See ArcLength.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "ArcLength.H"
+
+// 5 point Gauss-Legendre rule on [-1,1]
+static const double glNodes[5] = {
+	 0.0,
+	-0.5384693101056831,  0.5384693101056831,
+	-0.9061798459386640,  0.9061798459386640
+};
+static const double glWeights[5] = {
+	 0.5688888888888889,
+	 0.4786286704993665,  0.4786286704993665,
+	 0.2369268850561891,  0.2369268850561891
+};
+
+// stop splitting when the two halves agree with the whole to this
+// (relative) tolerance, or we've gone this deep
+static const double arcTolerance = 1e-6;
+static const int    arcMaxDepth  = 16;
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+ArcLengthTable::
+ArcLengthTable() : builtFrom((unsigned long)-1)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * |p'(u)| on one segment - the derivative of the cached cubic
+//============================================================================
+double ArcLengthTable::
+speed(size_t i, double u) const
+//============================================================================
+{
+	const Pnt3f* c = segments[i].pos;
+	double dx = (3.0 * c[0].x * u + 2.0 * c[1].x) * u + c[2].x;
+	double dy = (3.0 * c[0].y * u + 2.0 * c[1].y) * u + c[2].y;
+	double dz = (3.0 * c[0].z * u + 2.0 * c[1].z) * u + c[2].z;
+	return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+//****************************************************************************
+//
+// * one application of the Gauss-Legendre rule on [a,b]
+//============================================================================
+double ArcLengthTable::
+gaussLegendre(size_t i, double a, double b) const
+//============================================================================
+{
+	double half = 0.5 * (b - a);
+	double mid = 0.5 * (a + b);
+	double sum = 0;
+	for (int k = 0; k < 5; k++)
+		sum += glWeights[k] * speed(i, mid + half * glNodes[k]);
+	return sum * half;
+}
+
+//****************************************************************************
+//
+// * length of segment i between u0 and u1 - keep splitting the interval
+//   until the halves agree with the whole
+//============================================================================
+double ArcLengthTable::
+integrate(size_t i, double u0, double u1) const
+//============================================================================
+{
+	struct Interval { double a, b, whole; int depth; };
+
+	Interval stack[arcMaxDepth + 1];
+	int top = 0;
+	stack[0].a = u0;
+	stack[0].b = u1;
+	stack[0].whole = gaussLegendre(i, u0, u1);
+	stack[0].depth = 0;
+
+	double total = 0;
+	while (top >= 0) {
+		Interval in = stack[top--];
+		double mid = 0.5 * (in.a + in.b);
+		double left = gaussLegendre(i, in.a, mid);
+		double right = gaussLegendre(i, mid, in.b);
+
+		if (in.depth >= arcMaxDepth ||
+			fabs(left + right - in.whole) <= arcTolerance * (1.0 + fabs(in.whole))) {
+			total += left + right;
+		}
+		else {
+			// depth first - the stack never holds more than one
+			// pending interval per level
+			Interval r = { mid, in.b, right, in.depth + 1 };
+			Interval l = { in.a, mid, left, in.depth + 1 };
+			stack[++top] = r;
+			stack[++top] = l;
+		}
+	}
+	return total;
+}
+
+//****************************************************************************
+//
+// * bring the table up to date - only integrate the segments whose
+//   coefficients are different from last time
+//============================================================================
+void ArcLengthTable::
+build(const SplineCache& spline)
+//============================================================================
+{
+	if (spline.version() == builtFrom)
+		return;
+	unsigned long since = builtFrom;
+	builtFrom = spline.version();
+
+	size_t n = spline.segments.size();
+	size_t old = segments.size();
+
+	segments.resize(n);
+	segLength.resize(n);
+	cumulative.resize(n + 1);
+
+	for (size_t i = 0; i < n; i++) {
+		// untouched since we last looked
+		if (i < old && since != (unsigned long)-1 && spline.segmentVersion(i) <= since)
+			continue;
+
+		// the length only depends on the derivative - the t^3, t^2
+		// and t coefficients of the position (turning a point doesn't
+		// change any lengths)
+		if (i < old &&
+			!memcmp(segments[i].pos, spline.segments[i].pos, 3 * sizeof(Pnt3f)))
+			continue;
+
+		segments[i] = spline.segments[i];
+		segLength[i] = (float)integrate(i, 0.0, 1.0);
+	}
+
+	double sum = 0;
+	for (size_t i = 0; i < n; i++) {
+		cumulative[i] = sum;
+		sum += segLength[i];
+	}
+	cumulative[n] = sum;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+float ArcLengthTable::
+length() const
+//============================================================================
+{
+	return cumulative.empty() ? 0.0f : (float)cumulative.back();
+}
+
+//****************************************************************************
+//
+// * parameter to distance: the table gets us to the start of the segment,
+//   then integrate the rest of the way
+//============================================================================
+float ArcLengthTable::
+toDistance(float t) const
+//============================================================================
+{
+	size_t n = segLength.size();
+	if (!n)
+		return 0;
+
+	t = fmodf(t, (float)n);
+	if (t < 0)
+		t += (float)n;
+
+	size_t i = (size_t)floorf(t);
+	if (i >= n)
+		i = n - 1;
+
+	return (float)(cumulative[i] + integrate(i, 0.0, t - (float)i));
+}
+
+//****************************************************************************
+//
+// * distance to parameter: binary search for the segment, then find the
+//   parameter inside of it
+//============================================================================
+float ArcLengthTable::
+toParameter(float s) const
+//============================================================================
+{
+	size_t n = segLength.size();
+	float total = length();
+	if (!n || total <= 0)
+		return 0;
+
+	s = fmodf(s, total);
+	if (s < 0)
+		s += total;
+
+	// the last segment whose start is at or before s
+	size_t i = std::upper_bound(cumulative.begin(), cumulative.begin() + n, (double)s)
+				- cumulative.begin() - 1;
+
+	float t = (float)i + segmentParameter(i, s - cumulative[i]);
+	return (t >= (float)n) ? t - (float)n : t;
+}
+
+//****************************************************************************
+//
+// * Newton's method on  s(u) - d = 0  inside segment i (s'(u) is just the
+//   speed)
+//============================================================================
+float ArcLengthTable::
+segmentParameter(size_t i, double d) const
+//============================================================================
+{
+	double len = segLength[i];
+	if (len <= 0)
+		return 0;
+
+	// start from the linear guess, and keep track of how far we are along
+	// the segment so each step only integrates the piece we moved over
+	double u = std::min(1.0, std::max(0.0, d / len));
+	double at = integrate(i, 0.0, u);
+	for (int iter = 0; iter < 8; iter++) {
+		double err = at - d;
+		if (fabs(err) <= 1e-5 * (1.0 + len))
+			break;
+
+		double v = speed(i, u);
+		if (v <= 1e-12)
+			break;
+
+		double next = std::min(1.0, std::max(0.0, u - err / v));
+		at += integrate(i, u, next);
+		u = next;
+	}
+	return (float)u;
+}
@@ -0,0 +1,396 @@
+/************************************************************************
+     File:        RenderCheck.cpp
+
+     Comment:     Checks of the drawing code, without a window
+
+						The program itself only builds on Windows (that's
+						where the FlTk that comes with the project works),
+						but the GL pieces don't need a window. This draws
+						them offscreen through EGL, so it runs anywhere
+						there's an EGL with desktop GL - Mesa's llvmpipe,
+						with no GPU and no display, is enough.
+
+						It draws the default track the way TrainView does
+						and checks:
+
+							shadows		the shadow map's framebuffer is
+										complete, and a floor pixel under
+										a tie's shadow is darker than one
+										out in the light
+							picking		the ID buffer gives back a control
+										point, a track segment (with the t
+										where it was picked), a tie, and
+										nothing where there's nothing
+
+						and that GL didn't report any errors along the way.
+
+						One line for each check goes to stdout. The exit
+						status is 2 if any of them is off, and 1 if there's
+						no GL to run them on.
+
+						usage: RenderCheck
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Track.H"
+#include "TrackMesh.H"
+#include "ShadowMap.H"
+#include "Floor.H"
+#include "IdBuffer.H"
+
+// the floor's colors (in the program they come from 3DUtils.cpp, which
+// needs FlTk). both the same, so the checkerboard can't be mistaken for
+// a shadow
+float floorColor1[3] = { .6f, .6f, .6f };
+float floorColor2[3] = { .6f, .6f, .6f };
+
+// the offscreen window is this big on a side
+static const int viewSize = 256;
+
+// the sun, the same as TrainView's light 0
+static const Pnt3f toSun(0, 1, 1);
+
+// the camera (see lookAtTrack)
+static glm::mat4 projection, view;
+
+// set if any check is off
+static bool failed = false;
+
+//****************************************************************************
+//
+// * a GL context with a small offscreen surface. Mesa's surfaceless
+//   platform needs no display at all, so it's tried first
+//============================================================================
+static bool makeContext()
+//============================================================================
+{
+	EGLDisplay display = EGL_NO_DISPLAY;
+	const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (extensions && strstr(extensions, "EGL_MESA_platform_surfaceless")) {
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay)
+			display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+	}
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, 0, 0)) {
+		fprintf(stderr, "Can't start EGL\n");
+		return false;
+	}
+
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if (!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || !numConfigs) {
+		fprintf(stderr, "No EGL config with desktop GL\n");
+		return false;
+	}
+
+	const EGLint surfaceAttributes[] = { EGL_WIDTH, viewSize, EGL_HEIGHT, viewSize, EGL_NONE };
+	EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+
+	// the shaders are GLSL 3.30 with the compatibility profile (they still
+	// use the fixed function matrices and lights)
+	eglBindAPI(EGL_OPENGL_API);
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+	if (surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+		!eglMakeCurrent(display, surface, surface, context)) {
+		fprintf(stderr, "Can't make a GL 3.3 compatibility context (EGL error %x)\n",
+				eglGetError());
+		return false;
+	}
+
+	if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+		fprintf(stderr, "Can't load GL\n");
+		return false;
+	}
+
+	fprintf(stderr, "GL %s (%s)\n", glGetString(GL_VERSION), glGetString(GL_RENDERER));
+	return true;
+}
+
+//****************************************************************************
+//
+// * one line for each check
+//============================================================================
+static void report(const char* check, bool ok, const char* what)
+//============================================================================
+{
+	if (!ok)
+		failed = true;
+	printf("%-9s %s (%s)\n", check, ok ? "ok" : "FAILED", what);
+	fflush(stdout);
+}
+
+//****************************************************************************
+//
+// * the world cam's sort of view: from up and in front, looking down at
+//   the middle of the track - or from eye to at, for a closer look
+//============================================================================
+static void lookAtTrack(const Pnt3f& eye = Pnt3f(0, 250, 150),
+						const Pnt3f& at = Pnt3f(0, 0, 0))
+//============================================================================
+{
+	projection = glm::perspective(glm::radians(40.0f), 1.0f, 1.0f, 1000.0f);
+	view = glm::lookAt(glm::vec3(eye.x, eye.y, eye.z), glm::vec3(at.x, at.y, at.z),
+					   glm::vec3(0, 1, 0));
+
+	glViewport(0, 0, viewSize, viewSize);
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(glm::value_ptr(projection));
+	glMatrixMode(GL_MODELVIEW);
+	glLoadMatrixf(glm::value_ptr(view));
+}
+
+//****************************************************************************
+//
+// * the pixel p lands on
+//============================================================================
+static void pixelOf(const Pnt3f& p, int& x, int& y)
+//============================================================================
+{
+	glm::vec3 w = glm::project(glm::vec3(p.x, p.y, p.z), view, projection,
+							   glm::vec4(0, 0, viewSize, viewSize));
+	x = (int)w.x;
+	y = (int)w.y;
+}
+
+//****************************************************************************
+//
+// * the control points, as boxes (TrainView's are turned to their
+//   orientation, but these only have to be there) - into the ID buffer
+//   if there is one
+//============================================================================
+static void drawPoints(const CTrack& track, const IdBuffer* ids = 0)
+//============================================================================
+{
+	const float size = 2;
+	for (size_t i = 0; i < track.points.size(); i++) {
+		const Pnt3f& p = track.points[i].pos;
+		if (ids)
+			ids->setObject(PICK_CONTROL_POINT, (int)i, (float)i);
+		glBegin(GL_QUADS);
+			glNormal3f(0, 1, 0);
+			glVertex3f(p.x - size, p.y + size, p.z - size);
+			glVertex3f(p.x - size, p.y + size, p.z + size);
+			glVertex3f(p.x + size, p.y + size, p.z + size);
+			glVertex3f(p.x + size, p.y + size, p.z - size);
+		glEnd();
+	}
+}
+
+//****************************************************************************
+//
+// * a point on tie i: across it from the middle, and up from its middle
+//============================================================================
+static Pnt3f onTie(const TrackMesh& mesh, size_t i, float across, float up)
+//============================================================================
+{
+	const BoxInstance& tie = mesh.tieFrames()[i];
+	return Pnt3f(tie.pos[0] + across * tie.w[0] + up * tie.v[0],
+				 tie.pos[1] + across * tie.w[1] + up * tie.v[1],
+				 tie.pos[2] + across * tie.w[2] + up * tie.v[2]);
+}
+
+//****************************************************************************
+//
+// * what's at pixel x, y - the points and the track drawn into the ID
+//   buffer, and waited for
+//============================================================================
+static PickResult pickAt(IdBuffer& ids, const CTrack& track, TrackMesh& mesh, int x, int y)
+//============================================================================
+{
+	PickResult result = { PICK_NOTHING, -1, 0 };
+	if (!ids.begin(x, y, viewSize, viewSize))
+		return result;
+	drawPoints(track, &ids);
+	mesh.drawIds(ids);
+	ids.end();
+	while (!ids.poll(result))
+		;
+	return result;
+}
+
+//****************************************************************************
+//
+// * pick the top of a control point, the outside rail, the top of a tie
+//   and the empty middle of the loop (the floor isn't pickable)
+//============================================================================
+static void checkPicking(CTrack& track, TrackMesh& mesh)
+//============================================================================
+{
+	IdBuffer ids;
+	ids.createGL();
+	lookAtTrack();
+
+	char what[200];
+	int x, y;
+
+	Pnt3f top = track.points[2].pos;
+	top.y += 2;
+	pixelOf(top, x, y);
+	PickResult point = pickAt(ids, track, mesh, x, y);
+	sprintf(what, "control point 2 at %d,%d: kind %d index %d", x, y, point.kind, point.index);
+	report("picking", point.kind == PICK_CONTROL_POINT && point.index == 2, what);
+
+	// the rail is a line a pixel wide, and can be under a tie - so step
+	// along segment 1 until it's hit
+	const SplineCache& spline = track.spline(SPLINE_CARDINAL);
+	const FrameTable& frames = track.frames(SPLINE_CARDINAL);
+	PickResult rail = { PICK_NOTHING, -1, 0 };
+	float railT = 1.3f;
+	for (; railT < 1.7f; railT += 0.02f) {
+		Pnt3f pos, dir, up, u, v, w;
+		spline.eval(railT, pos, dir, up);
+		frames.frameAt(railT, u, v, w);
+		pixelOf(pos + w * 2.95f + v * 0.7f, x, y);
+		rail = pickAt(ids, track, mesh, x, y);
+		if (rail.kind == PICK_TRACK)
+			break;
+	}
+	sprintf(what, "rail at t %g: kind %d segment %d t %g", railT, rail.kind, rail.index, rail.t);
+	report("picking", rail.kind == PICK_TRACK && rail.index == 1 &&
+		   fabsf(rail.t - railT) < 0.05f, what);
+
+	// half way out along the top of a tie, between the rails - from
+	// close enough that the rails don't cover it
+	size_t tie = mesh.tieFrames().size() / 3;
+	Pnt3f onTop = onTie(mesh, tie, 1.5f, 0.75f);
+	lookAtTrack(onTop + Pnt3f(5, 40, 5), onTop);
+	pixelOf(onTop, x, y);
+	PickResult tiePick = pickAt(ids, track, mesh, x, y);
+	sprintf(what, "tie %d at %d,%d: kind %d index %d t %g (want %g)", (int)tie, x, y,
+			tiePick.kind, tiePick.index, tiePick.t, mesh.tieFrames()[tie].t);
+	report("picking", tiePick.kind == PICK_TIE && tiePick.index == (int)tie &&
+		   fabsf(tiePick.t - mesh.tieFrames()[tie].t) < 1e-4f, what);
+
+	lookAtTrack();
+	pixelOf(Pnt3f(0, 0, 0), x, y);
+	PickResult nothing = pickAt(ids, track, mesh, x, y);
+	sprintf(what, "middle at %d,%d: kind %d", x, y, nothing.kind);
+	report("picking", nothing.kind == PICK_NOTHING, what);
+
+	ids.releaseGL();
+}
+
+//****************************************************************************
+//
+// * draw the shadow map the way TrainView does, then just the floor with
+//   it, and compare where a tie's shadow falls with the open middle
+//============================================================================
+static void checkShadows(CTrack& track, TrackMesh& mesh)
+//============================================================================
+{
+	ShadowMap shadowMap;
+	Floor ground;
+	shadowMap.createGL();
+	ground.createGL();
+
+	// createGL lets the framebuffer go if it isn't complete
+	report("shadows", shadowMap.isValid(), "shadow map framebuffer complete");
+
+	float radius = 50.0f;
+	for (size_t i = 0; i < track.points.size(); i++) {
+		const Pnt3f& p = track.points[i].pos;
+		radius = std::max(radius, sqrtf(p.x * p.x + p.y * p.y + p.z * p.z) + 20.0f);
+	}
+	shadowMap.beginDepth(toSun, Pnt3f(0, 0, 0), radius);
+	drawPoints(track);
+	mesh.draw(true, &shadowMap);
+	shadowMap.endDepth();
+
+	glClearColor(0, 0, .3f, 0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+	lookAtTrack();
+	GLfloat sun[] = { toSun.x, toSun.y, toSun.z, 0 };
+	glLightfv(GL_LIGHT0, GL_POSITION, sun);
+
+	shadowMap.beginLit(1);
+	ground.draw(&shadowMap);
+	shadowMap.endLit();
+
+	// a tie a third of the way round - its shadow is down the sun's rays
+	// from it, on the floor
+	size_t tie = mesh.tieFrames().size() / 3;
+	Pnt3f middle = onTie(mesh, tie, 0, 0);
+	Pnt3f under = middle - toSun * (middle.y / toSun.y);
+	int ux, uy, ox, oy;
+	pixelOf(under, ux, uy);
+	pixelOf(Pnt3f(0, 0, 0), ox, oy);
+	unsigned char shaded[4], open[4];
+	glReadPixels(ux, uy, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, shaded);
+	glReadPixels(ox, oy, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, open);
+
+	// in the shadow the floor is half as bright - allow for the edge of
+	// the shadow being blurred a little
+	char what[200];
+	sprintf(what, "under tie %d at %d,%d: %d, in the open at %d,%d: %d",
+			(int)tie, ux, uy, shaded[0], ox, oy, open[0]);
+	report("shadows", open[0] > 0 && shaded[0] < open[0] * 3 / 4, what);
+
+	ground.releaseGL();
+	shadowMap.releaseGL();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int main(int argc, char** argv)
+//============================================================================
+{
+	if (argc > 1) {
+		fprintf(stderr, "usage: %s\n", argv[0]);
+		return 1;
+	}
+	if (!makeContext())
+		return 1;
+	while (glGetError() != GL_NO_ERROR)
+		;
+
+	CTrack track;
+	TrackMesh mesh;
+	mesh.createGL();
+	TessellateTolerance tolerance = { 0.25f, 0.16f, 8 };
+	mesh.update(track.spline(SPLINE_CARDINAL), track.frames(SPLINE_CARDINAL), tolerance);
+
+	checkShadows(track, mesh);
+	checkPicking(track, mesh);
+	mesh.releaseGL();
+
+	GLenum error = glGetError();
+	char what[50];
+	sprintf(what, "glGetError %x", error);
+	report("errors", error == GL_NO_ERROR, what);
+
+	return failed ? 2 : 0;
+}
@@ -0,0 +1,960 @@
+/************************************************************************
+     File:        TrackBench.cpp
+
+     Comment:     Micro-benchmarks for the track code
+
+						Times the pieces of TrackCore that scale with the
+						number of control points, on synthetic tracks from
+						4 up to 65535 points (the most readPoints takes):
+
+							build		compute the spline coefficients
+							eval		cached evaluation (what getPnt3f does)
+							reference	evaluation by basis matrix multiply
+							batch		evaluation through the SIMD batch
+										evaluator (SplineBatch.H)
+							arclength	integrate the arc length table
+							frames		build the rotation minimizing frame
+										table (reports how many frames)
+							tessellate	sample the whole track with frames
+							forward		the same, by forward differences
+							adaptive	sample only as finely as the curves
+										need (reports how many samples)
+							frames_mt, tessellate_mt, adaptive_mt
+										the same on a WorkPool with a
+										thread per core (but at least 4,
+										so the check below really runs
+										threads even on one core)
+							drag		move one point and bring the spline,
+										the arc length table, the frames
+										and the samples up to date (only the
+										segments around the point)
+							write/read	save and load the text and binary
+										formats (the format is reported
+										where the spline type would be)
+							snapshot	a new version of the track (see
+										TrackSnapshot.H) with one point
+										moved, added or taken away
+							pickbuild	build the pick index from scratch
+							pick		cast a ray at the control points
+										(also run on 100000 points, more
+										than a file can hold)
+							advance		move every car of every train one
+										step (trains of 100 cars, on the
+										largest track - points is how many
+										cars there are)
+							carframes	the frame every car is drawn in,
+										the way the simulation works them
+										out for each snapshot (distance to
+										parameter, spline, frame table)
+							physics		the same, coasting under gravity
+										(TrainPhysics.H)
+
+						The physics is also run for ten simulated minutes
+						without friction, and the energy of every train is
+						checked against what it started with.
+
+						Every result is one line of JSON on stdout (or in the
+						file given with -o), so runs can be compared from
+						commit to commit. A readable table goes to stderr.
+
+						Before timing, the batch evaluator is checked against
+						the cache (which it should match exactly) and against
+						the basis matrix reference (within a tolerance), and
+						forward differencing against the batch evaluator,
+						the threaded frames and samples against the serial
+						ones (which they should match exactly), snapshot
+						edits against the same edits to a vector, the pick
+						index against trying every point, and the physics
+						for keeping its energy.
+						The exit status is 2 if any of them is off.
+
+						usage: TrackBench [-o file] [-quick] [-max N]
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Track.H"
+#include "TrackFile.H"
+#include "Tessellate.H"
+#include "SplineBatch.H"
+#include "WorkPool.H"
+#include "TrainSimulation.H"
+
+// keep the compiler from throwing away the work we're timing
+static volatile float sink;
+
+static const char* splineNames[3] = { "linear", "cardinal", "bspline" };
+
+// the largest track readPoints will load
+static const int maxTrackPoints = 65535;
+
+// how long to keep repeating each measurement
+static double minSeconds = 0.2;
+
+static FILE* out = stdout;
+
+// set if the batch evaluator doesn't agree with the others
+static bool disagreed = false;
+
+//****************************************************************************
+//
+// * seconds since some fixed point
+//============================================================================
+static double now()
+//============================================================================
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+//****************************************************************************
+//
+// * a track with n points: a wobbly loop, with the orientation rolling
+//   back and forth so the up vector has some work to do
+//============================================================================
+static void makeTrack(CTrack& track, int n)
+//============================================================================
+{
+	track.points.clear();
+	float radius = 10.0f * (float)n / 6.2831853f + 50.0f;
+	for (int i = 0; i < n; i++) {
+		float a = 6.2831853f * (float)i / (float)n;
+		Pnt3f pos(radius * cosf(a), 20.0f + 15.0f * sinf(7.0f * a), radius * sinf(a));
+		Pnt3f orient(0.3f * sinf(3.0f * a), 1.0f, 0.0f);
+		track.points.push_back(ControlPoint(pos, orient));
+	}
+	track.pointsChanged();
+}
+
+//****************************************************************************
+//
+// * one result - a line of JSON, and a line of the table
+//============================================================================
+static void report(const char* bench, const char* spline, int points,
+				   double ops, double seconds, const char* unit, double perSecond)
+//============================================================================
+{
+	double nsPerOp = seconds * 1e9 / ops;
+	fprintf(out, "{\"benchmark\":\"%s\",\"spline\":\"%s\",\"points\":%d,"
+		"\"ops\":%.0f,\"seconds\":%.6f,\"ns_per_op\":%.3f,\"%s_per_second\":%.1f}\n",
+		bench, spline, points, ops, seconds, nsPerOp, unit, perSecond);
+	fflush(out);
+
+	fprintf(stderr, "%-11s %-9s %6d %12.1f ns/op %14.1f %s/s\n",
+		bench, spline, points, nsPerOp, perSecond, unit);
+}
+
+//****************************************************************************
+//
+// * evaluate the whole track, through the cache
+//============================================================================
+static void benchEval(CTrack& track, SplineType type, int n)
+//============================================================================
+{
+	const SplineCache& spline = track.spline(type);
+	const int perPass = 4096;
+	float step = (float)n / (float)perPass;
+
+	double ops = 0, start = now(), elapsed;
+	Pnt3f pos, dir, up;
+	float acc = 0;
+	do {
+		for (int i = 0; i < perPass; i++) {
+			spline.eval(step * (float)i, pos, dir, up);
+			acc += pos.x + dir.y + up.z;
+		}
+		ops += perPass;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+	sink = acc;
+
+	report("eval", splineNames[type - 1], n, ops, elapsed, "points", ops / elapsed);
+}
+
+//****************************************************************************
+//
+// * the same, but multiplying the basis matrix out every time
+//============================================================================
+static void benchReference(CTrack& track, SplineType type, int n)
+//============================================================================
+{
+	const int perPass = 4096;
+	float step = (float)n / (float)perPass;
+
+	double ops = 0, start = now(), elapsed;
+	Pnt3f pos, dir, up;
+	float acc = 0;
+	do {
+		for (int i = 0; i < perPass; i++) {
+			evalReference(track.points, type, step * (float)i, pos, dir, up);
+			acc += pos.x + dir.y + up.z;
+		}
+		ops += perPass;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+	sink = acc;
+
+	report("reference", splineNames[type - 1], n, ops, elapsed, "points", ops / elapsed);
+}
+
+//****************************************************************************
+//
+// * the same points again, all at once through the batch evaluator
+//============================================================================
+static void benchBatch(CTrack& track, SplineType type, int n)
+//============================================================================
+{
+	const SplineCache& spline = track.spline(type);
+	const int perPass = 4096;
+	float step = (float)n / (float)perPass;
+
+	std::vector<float> t(perPass);
+	for (int i = 0; i < perPass; i++)
+		t[i] = step * (float)i;
+
+	SplineBatch batch;
+	double ops = 0, start = now(), elapsed;
+	float acc = 0;
+	do {
+		evalBatch(spline, &t[0], t.size(), batch);
+		acc += batch.pos[0][perPass - 1] + batch.dir[1][0] + batch.up[2][1];
+		ops += perPass;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+	sink = acc;
+
+	report("batch", splineNames[type - 1], n, ops, elapsed, "points", ops / elapsed);
+}
+
+//****************************************************************************
+//
+// * make sure the batch evaluator gives the same answers: exactly what
+//   the cache gives (it does the same arithmetic), and close to the basis
+//   matrix multiply (which adds things up in a different order). the
+//   reference tolerance is relative to the size of the track
+//============================================================================
+static void checkBatch(CTrack& track, SplineType type, int n)
+//============================================================================
+{
+	const SplineCache& spline = track.spline(type);
+	const int count = 4099;		// not a multiple of the lanes, to hit the tail
+	std::vector<float> t(count);
+	for (int i = 0; i < count; i++)
+		t[i] = (float)n * (float)i / (float)(count - 1) - 0.5f;
+
+	SplineBatch batch;
+	evalBatch(spline, &t[0], t.size(), batch);
+
+	int mismatches = 0;
+	float posDiff = 0, vecDiff = 0, scale = 1;
+	for (int i = 0; i < count; i++) {
+		Pnt3f pos, dir, up, rpos, rdir, rup;
+		spline.eval(t[i], pos, dir, up);
+		evalReference(track.points, type, t[i], rpos, rdir, rup);
+
+		Pnt3f bpos = batch.position(i), bdir = batch.direction(i), bup = batch.upVector(i);
+		if (memcmp(pos.v(), bpos.v(), 3 * sizeof(float)) ||
+			memcmp(dir.v(), bdir.v(), 3 * sizeof(float)) ||
+			memcmp(up.v(), bup.v(), 3 * sizeof(float)))
+			mismatches++;
+
+		for (int k = 0; k < 3; k++) {
+			posDiff = fmaxf(posDiff, fabsf(bpos.v()[k] - rpos.v()[k]));
+			vecDiff = fmaxf(vecDiff, fabsf(bdir.v()[k] - rdir.v()[k]));
+			vecDiff = fmaxf(vecDiff, fabsf(bup.v()[k] - rup.v()[k]));
+			scale = fmaxf(scale, fabsf(rpos.v()[k]));
+		}
+	}
+
+	// both ways lose about float epsilon times the size of the coordinates
+	// when they add the terms up, and the directions get that divided by
+	// the speed, so far from the origin they drift apart a little more
+	bool ok = mismatches == 0 && posDiff <= 1e-5f * scale &&
+		vecDiff <= 1e-3f + 1e-7f * scale;
+	if (!ok)
+		disagreed = true;
+
+	fprintf(out, "{\"benchmark\":\"batch_check\",\"spline\":\"%s\",\"points\":%d,"
+		"\"lanes\":%d,\"samples\":%d,\"cache_mismatches\":%d,"
+		"\"reference_pos_diff\":%g,\"reference_vec_diff\":%g,\"ok\":%s}\n",
+		splineNames[type - 1], n, splineBatchWidth(), count, mismatches,
+		posDiff, vecDiff, ok ? "true" : "false");
+	fflush(out);
+
+	fprintf(stderr, "%-11s %-9s %6d %s (%d lanes, %d differ from cache, "
+		"reference within %g / %g)\n", "batch_check", splineNames[type - 1], n,
+		ok ? "ok" : "FAILED", splineBatchWidth(), mismatches, posDiff, vecDiff);
+}
+
+//****************************************************************************
+//
+// * building the coefficients (what happens after every edit)
+//============================================================================
+static void benchBuild(CTrack& track, SplineType type, int n)
+//============================================================================
+{
+	double ops = 0, start = now(), elapsed;
+	do {
+		track.pointsChanged();
+		sink = track.spline(type).segments[0].pos[3].x;
+		ops += 1;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+
+	report("build", splineNames[type - 1], n, ops, elapsed, "segments", ops * n / elapsed);
+}
+
+//****************************************************************************
+//
+// * the arc length table, from scratch
+//============================================================================
+static void benchArcLength(CTrack& track, SplineType type, int n)
+//============================================================================
+{
+	double ops = 0, start = now(), elapsed;
+	do {
+		// a fresh table, so every segment gets integrated
+		ArcLengthTable table;
+		table.build(track.spline(type));
+		sink = table.length();
+		ops += 1;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+
+	report("arclength", splineNames[type - 1], n, ops, elapsed, "segments", ops * n / elapsed);
+}
+
+//****************************************************************************
+//
+// * the frame table, from scratch
+//============================================================================
+static void benchFrames(CTrack& track, SplineType type, int n, WorkPool* pool = 0)
+//============================================================================
+{
+	const SplineCache& spline = track.spline(type);
+	const ArcLengthTable& arc = track.arcLength(type);
+	size_t frames = 0;
+
+	double ops = 0, start = now(), elapsed;
+	do {
+		FrameTable table;
+		table.build(spline, arc, pool);
+		frames = table.size();
+		ops += 1;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+
+	report(pool ? "frames_mt" : "frames", splineNames[type - 1], n, ops, elapsed, "frames",
+		ops * (double)frames / elapsed);
+}
+
+//****************************************************************************
+//
+// * sample the whole track, the way the track mesh does
+//============================================================================
+static void benchTessellate(CTrack& track, SplineType type, int n, int divide,
+							TessellateMethod method, WorkPool* pool = 0)
+//============================================================================
+{
+	const SplineCache& spline = track.spline(type);
+	TrackSamples samples;
+
+	double ops = 0, start = now(), elapsed;
+	do {
+		tessellate(spline, divide, samples, method, pool);
+		sink = samples.pos[0].x;
+		ops += 1;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+
+	report(method == TESSELLATE_FORWARD ? "forward" : (pool ? "tessellate_mt" : "tessellate"),
+		splineNames[type - 1], n, ops, elapsed, "samples",
+		ops * (double)samples.pieces() / elapsed);
+}
+
+//****************************************************************************
+//
+// * adaptive sampling, with the tolerances TrainView draws with
+//============================================================================
+static void benchAdaptive(CTrack& track, SplineType type, int n, WorkPool* pool = 0)
+//============================================================================
+{
+	const char* name = pool ? "adaptive_mt" : "adaptive";
+	const SplineCache& spline = track.spline(type);
+	TessellateTolerance tolerance = { 0.25f, 0.16f, 8 };
+	TrackSamples samples;
+
+	double ops = 0, start = now(), elapsed;
+	do {
+		tessellateAdaptive(spline, tolerance, samples, pool);
+		sink = samples.pos[0].x;
+		ops += 1;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+
+	fprintf(out, "{\"benchmark\":\"%s\",\"spline\":\"%s\",\"points\":%d,"
+		"\"ops\":%.0f,\"seconds\":%.6f,\"ns_per_op\":%.3f,\"samples\":%d,"
+		"\"samples_at_divide_10\":%d}\n",
+		name, splineNames[type - 1], n, ops, elapsed, elapsed * 1e9 / ops,
+		(int)samples.pieces(), n * 10);
+	fflush(out);
+
+	fprintf(stderr, "%-11s %-9s %6d %12.1f ns/op %8d samples (%d at divide 10)\n",
+		name, splineNames[type - 1], n, elapsed * 1e9 / ops,
+		(int)samples.pieces(), n * 10);
+}
+
+//****************************************************************************
+//
+// * what happens while a point is being dragged: one point moves a
+//   little, and everything built from the spline catches up
+//============================================================================
+static void benchDrag(CTrack& track, SplineType type, int n)
+//============================================================================
+{
+	TessellateTolerance tolerance = { 0.25f, 0.16f, 8 };
+	TrackSamples samples;
+	ArcLengthTable table;
+	FrameTable frames;
+
+	const SplineCache& spline = track.spline(type);
+	unsigned long built = spline.version();
+	table.build(spline);
+	frames.build(spline, table);
+	tessellateAdaptive(spline, tolerance, samples);
+
+	size_t i = (size_t)n / 2;
+	float step = 0.01f;
+
+	double ops = 0, start = now(), elapsed;
+	do {
+		track.points[i].pos.y += step;
+		step = -step;
+		track.pointChanged(i);
+
+		const SplineCache& moved = track.spline(type);
+		table.build(moved);
+		frames.build(moved, table);
+		retessellateAdaptive(moved, tolerance, built, samples);
+		built = moved.version();
+
+		sink = samples.pos[0].x + table.length();
+		ops += 1;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+
+	report("drag", splineNames[type - 1], n, ops, elapsed, "edits", ops / elapsed);
+}
+
+//****************************************************************************
+//
+// * edits to a snapshot of the track: one moved, one added and one taken
+//   away at a time, at points spread around the track (so the count stays
+//   the same). the first time, the same edits are made to a copy of the
+//   points, and the versions checked against it
+//============================================================================
+static void benchSnapshot(CTrack& track, int n)
+//============================================================================
+{
+	TrackSnapshot snap = track.snapshot();
+	std::vector<ControlPoint> copy = track.points;
+	TrackSnapshot first = snap;
+	bool ok = true;
+	for (int k = 0; k < 300; k++) {
+		size_t i = ((size_t)k * 7919) % copy.size();
+		ControlPoint p(Pnt3f((float)k, 1, 2));
+		copy[i] = p;
+		snap = snap.set(i, p);
+		copy.insert(copy.begin() + i, p);
+		snap = snap.insert(i, p);
+		copy.erase(copy.begin() + (i * 3) % copy.size());
+		snap = snap.erase((i * 3) % snap.size());
+	}
+	std::vector<ControlPoint> got, before;
+	snap.copyTo(got);
+	first.copyTo(before);
+	for (size_t i = 0; ok && i < copy.size(); i++)
+		ok = got.size() == copy.size() && !memcmp(&got[i], &copy[i], sizeof(ControlPoint)) &&
+			!memcmp(&before[i], &track.points[i], sizeof(ControlPoint));
+	if (!ok)
+		disagreed = true;
+
+	fprintf(out, "{\"benchmark\":\"snapshot_check\",\"points\":%d,\"ok\":%s}\n",
+		n, ok ? "true" : "false");
+	fflush(out);
+	fprintf(stderr, "%-11s %-9s %6d %s\n", "snap_check", "points", n, ok ? "ok" : "FAILED");
+
+	snap = track.snapshot();
+	size_t k = 0;
+	double ops = 0, start = now(), elapsed;
+	do {
+		size_t i = (k++ * 7919) % snap.size();
+		snap = snap.set(i, ControlPoint(Pnt3f((float)k, 1, 2)));
+		snap = snap.insert(i, ControlPoint(Pnt3f((float)k, 2, 2)));
+		snap = snap.erase((i * 3) % snap.size());
+		ops += 3;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+	sink = snap[0].pos.x;
+
+	report("snapshot", "points", n, ops, elapsed, "edits", ops / elapsed);
+}
+
+//****************************************************************************
+//
+// * ray r: down at a slant onto one of the points - or, every fourth
+//   one, just past it
+//============================================================================
+static void pickRay(const CTrack& track, int r, Pnt3f& origin, Pnt3f& dir)
+//============================================================================
+{
+	Pnt3f target = track.points[((size_t)r * 7919) % track.points.size()].pos;
+	if (r % 4 == 3)
+		target.z += 3.0f * pickRadius;
+	origin = target + Pnt3f(50.0f * sinf((float)r), 200.0f, 50.0f * cosf((float)r));
+	dir = target - origin;
+}
+
+//****************************************************************************
+//
+// * the closest point a ray hits, by trying all of them
+//============================================================================
+static int pickEvery(const CTrack& track, const Pnt3f& origin, const Pnt3f& dir)
+//============================================================================
+{
+	float length = sqrtf(dir.x * dir.x + dir.y * dir.y + dir.z * dir.z);
+	Pnt3f d = dir * (1.0f / length);
+	int best = -1;
+	float bestT = 0;
+	for (size_t i = 0; i < track.points.size(); i++) {
+		Pnt3f oc = origin - track.points[i].pos;
+		float b = oc.x * d.x + oc.y * d.y + oc.z * d.z;
+		float disc = b * b - (oc.x * oc.x + oc.y * oc.y + oc.z * oc.z) + pickRadius * pickRadius;
+		if (disc < 0)
+			continue;
+		float t = std::max(-b - sqrtf(disc), 0.0f);
+		if (-b + sqrtf(disc) >= 0 && (best < 0 || t < bestT)) {
+			best = (int)i;
+			bestT = t;
+		}
+	}
+	return best;
+}
+
+//****************************************************************************
+//
+// * building the pick index, and casting rays with it
+//============================================================================
+static void benchPick(CTrack& track, int n)
+//============================================================================
+{
+	double ops = 0, start = now(), elapsed;
+	do {
+		PickIndex index;
+		index.build(track.points);
+		sink = (float)index.size();
+		ops += 1;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+	report("pickbuild", "points", n, ops, elapsed, "points", ops * n / elapsed);
+
+	const PickIndex& index = track.pickIndex();
+	Pnt3f origin, dir;
+
+	for (int r = 0; r < 64; r++) {
+		pickRay(track, r, origin, dir);
+		int fast = index.pick(origin, dir), slow = pickEvery(track, origin, dir);
+		if (fast != slow) {
+			fprintf(stderr, "pick: ray %d hit %d, should be %d (%d points)\n",
+				r, fast, slow, n);
+			disagreed = true;
+			break;
+		}
+	}
+
+	int hits = 0;
+	ops = 0;
+	start = now();
+	do {
+		for (int r = 0; r < 1000; r++) {
+			pickRay(track, r, origin, dir);
+			hits += index.pick(origin, dir) >= 0;
+		}
+		ops += 1000;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+	sink = (float)hits;
+
+	report("pick", "points", n, ops, elapsed, "rays", ops / elapsed);
+}
+
+//****************************************************************************
+//
+// * one tick of the trains, for however many cars
+//============================================================================
+static void benchAdvance(CTrack& track, int cars)
+//============================================================================
+{
+	float length = track.arcLength(SPLINE_CARDINAL).length();
+	TrainSet trains;
+	trains.make(std::max(cars / 100, 1), std::min(cars, 100), length);
+	for (size_t k = 0; k < trains.numTrains(); k++)
+		trains.setVelocity(k, 60.0f + (float)k);
+
+	double ops = 0, start = now(), elapsed;
+	do {
+		for (int r = 0; r < 100; r++)
+			trains.advance(1.0f / 120.0f, length);
+		ops += 100;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+	sink = trains.s[0];
+
+	report("advance", "cars", cars, ops, elapsed, "cars", ops * cars / elapsed);
+}
+
+//****************************************************************************
+//
+// * every car's frame, for however many cars - once per snapshot, on top
+//   of the steps
+//============================================================================
+static void benchCarFrames(CTrack& track, int cars)
+//============================================================================
+{
+	const SplineCache& spline = track.spline(SPLINE_CARDINAL);
+	const ArcLengthTable& arc = track.arcLength(SPLINE_CARDINAL);
+	const FrameTable& frames = track.frames(SPLINE_CARDINAL);
+
+	TrainSet trains;
+	trains.make(std::max(cars / 100, 1), std::min(cars, 100), arc.length());
+	for (size_t k = 0; k < trains.numTrains(); k++)
+		trains.setVelocity(k, 60.0f + (float)k);
+	std::vector<BoxInstance> out;
+
+	double ops = 0, start = now(), elapsed;
+	do {
+		trains.advance(1.0f / 60.0f, arc.length());
+		placeCars(trains, spline, arc, frames, out);
+		ops += 1;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+	sink = out[0].pos[0];
+
+	report("carframes", "cars", cars, ops, elapsed, "cars", ops * cars / elapsed);
+}
+
+//****************************************************************************
+//
+// * a physics step for however many cars, and (the first time) whether
+//   trains without friction keep their energy
+//============================================================================
+static void benchPhysics(CTrack& track, int cars)
+//============================================================================
+{
+	const GradeTable& grades = track.grades(SPLINE_CARDINAL);
+	TrainSet trains;
+	TrainPhysics physics;
+	const float dt = 1.0f / 120.0f;
+
+	if (cars == 100) {
+		physics.rollingFriction = physics.drag = 0;
+		trains.make(10, 10, grades.length());
+		std::vector<float> start(trains.numTrains());
+		for (size_t k = 0; k < trains.numTrains(); k++) {
+			trains.setVelocity(k, 30.0f + 2.0f * (float)k);
+			start[k] = physics.energy(trains, grades, k);
+		}
+
+		int steps = 10 * 60 * 120;
+		float drift = 0;
+		for (int i = 0; i < steps; i++) {
+			physics.step(trains, grades, dt);
+			if (i % 120 == 0)
+				for (size_t k = 0; k < trains.numTrains(); k++)
+					drift = fmaxf(drift, fabsf(physics.energy(trains, grades, k) - start[k]) / start[k]);
+		}
+
+		bool ok = drift < 0.01f;
+		if (!ok)
+			disagreed = true;
+		fprintf(out, "{\"benchmark\":\"energy_check\",\"spline\":\"cardinal\",\"cars\":%d,"
+			"\"steps\":%d,\"drift\":%g,\"ok\":%s}\n", cars, steps, drift, ok ? "true" : "false");
+		fflush(out);
+		fprintf(stderr, "%-11s %-9s %6d %s (energy within %g over %d steps)\n", "energy",
+			"cardinal", cars, ok ? "ok" : "FAILED", drift, steps);
+		physics = TrainPhysics();
+	}
+
+	trains.make(std::max(cars / 100, 1), std::min(cars, 100), grades.length());
+	for (size_t k = 0; k < trains.numTrains(); k++)
+		trains.setVelocity(k, 30.0f);
+
+	double ops = 0, start = now(), elapsed;
+	do {
+		for (int r = 0; r < 100; r++)
+			physics.step(trains, grades, dt);
+		ops += 100;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+	sink = trains.s[0];
+
+	report("physics", "cars", cars, ops, elapsed, "cars", ops * cars / elapsed);
+}
+
+//****************************************************************************
+//
+// * how far forward differencing drifts from evaluating every sample, with
+//   enough samples per segment that it has to re-anchor
+//============================================================================
+static void checkForward(CTrack& track, SplineType type, int n, int divide)
+//============================================================================
+{
+	const SplineCache& spline = track.spline(type);
+	TrackSamples exact, forward;
+	tessellate(spline, divide, exact, TESSELLATE_BATCH);
+	tessellate(spline, divide, forward, TESSELLATE_FORWARD);
+
+	float posDiff = 0, frameDiff = 0, scale = 1;
+	for (size_t i = 0; i < exact.pos.size(); i++) {
+		for (int k = 0; k < 3; k++) {
+			posDiff = fmaxf(posDiff, fabsf(exact.pos[i].v()[k] - forward.pos[i].v()[k]));
+			frameDiff = fmaxf(frameDiff, fabsf(exact.u[i].v()[k] - forward.u[i].v()[k]));
+			frameDiff = fmaxf(frameDiff, fabsf(exact.v[i].v()[k] - forward.v[i].v()[k]));
+			scale = fmaxf(scale, fabsf(exact.pos[i].v()[k]));
+		}
+	}
+
+	// same tolerances as the batch check
+	bool ok = posDiff <= 1e-5f * scale && frameDiff <= 1e-3f + 1e-7f * scale;
+	if (!ok)
+		disagreed = true;
+
+	fprintf(out, "{\"benchmark\":\"forward_check\",\"spline\":\"%s\",\"points\":%d,"
+		"\"divide\":%d,\"pos_diff\":%g,\"frame_diff\":%g,\"ok\":%s}\n",
+		splineNames[type - 1], n, divide, posDiff, frameDiff, ok ? "true" : "false");
+	fflush(out);
+
+	fprintf(stderr, "%-11s %-9s %6d %s (divide %d, within %g / %g)\n", "fwd_check",
+		splineNames[type - 1], n, ok ? "ok" : "FAILED", divide, posDiff, frameDiff);
+}
+
+//****************************************************************************
+//
+// * whether two sets of samples are the same, bit for bit
+//============================================================================
+static bool sameSamples(const TrackSamples& a, const TrackSamples& b)
+//============================================================================
+{
+	size_t n = a.pos.size();
+	if (b.pos.size() != n || a.segmentFirst != b.segmentFirst)
+		return false;
+	return !memcmp(a.t.data(), b.t.data(), n * sizeof(float)) &&
+		!memcmp(a.pos.data(), b.pos.data(), n * sizeof(Pnt3f)) &&
+		!memcmp(a.u.data(), b.u.data(), n * sizeof(Pnt3f)) &&
+		!memcmp(a.v.data(), b.v.data(), n * sizeof(Pnt3f)) &&
+		!memcmp(a.w.data(), b.w.data(), n * sizeof(Pnt3f));
+}
+
+//****************************************************************************
+//
+// * the threaded frames and samples against the serial ones - each
+//   segment is done the same way on whatever thread, so they should be
+//   exactly the same
+//============================================================================
+static void checkParallel(CTrack& track, SplineType type, int n, WorkPool& pool)
+//============================================================================
+{
+	const SplineCache& spline = track.spline(type);
+	const ArcLengthTable& arc = track.arcLength(type);
+	TessellateTolerance tolerance = { 0.25f, 0.16f, 8 };
+	TrackSamples serial, threaded;
+
+	tessellate(spline, 10, serial, TESSELLATE_BATCH);
+	tessellate(spline, 10, threaded, TESSELLATE_BATCH, &pool);
+	bool samplesOk = sameSamples(serial, threaded);
+	tessellate(spline, 10, serial, TESSELLATE_FORWARD);
+	tessellate(spline, 10, threaded, TESSELLATE_FORWARD, &pool);
+	samplesOk = samplesOk && sameSamples(serial, threaded);
+	tessellateAdaptive(spline, tolerance, serial);
+	tessellateAdaptive(spline, tolerance, threaded, &pool);
+	samplesOk = samplesOk && sameSamples(serial, threaded);
+
+	// the frame tables only show their frames through frameAt
+	FrameTable serialFrames, threadedFrames;
+	serialFrames.build(spline, arc);
+	threadedFrames.build(spline, arc, &pool);
+	bool framesOk = serialFrames.size() == threadedFrames.size();
+	for (size_t i = 0; framesOk && i < spline.size(); i++) {
+		for (int k = 0; k <= 16; k++) {
+			Pnt3f a[3], b[3];
+			serialFrames.frameAt(i, k / 16.0f, a[0], a[1], a[2]);
+			threadedFrames.frameAt(i, k / 16.0f, b[0], b[1], b[2]);
+			if (memcmp(a, b, sizeof(a)))
+				framesOk = false;
+		}
+	}
+
+	// with one thread it's just the serial path again - that proves nothing
+	bool manyThreads = pool.size() >= 2;
+	bool ok = samplesOk && framesOk && manyThreads;
+	if (!ok)
+		disagreed = true;
+
+	fprintf(out, "{\"benchmark\":\"parallel_check\",\"spline\":\"%s\",\"points\":%d,"
+		"\"threads\":%d,\"samples_same\":%s,\"frames_same\":%s,\"ok\":%s}\n",
+		splineNames[type - 1], n, pool.size(), samplesOk ? "true" : "false",
+		framesOk ? "true" : "false", ok ? "true" : "false");
+	fflush(out);
+
+	fprintf(stderr, "%-11s %-9s %6d %s (%d threads%s)\n", "mt_check",
+		splineNames[type - 1], n, ok ? "ok" : "FAILED", pool.size(),
+		manyThreads ? "" : " - not enough to check anything");
+}
+
+//****************************************************************************
+//
+// * write and read the track file - text or binary depending on the
+//   name (see TrackFile.H)
+//============================================================================
+static void benchFiles(CTrack& track, int n, const char* path, const char* format)
+//============================================================================
+{
+	double ops = 0, start = now(), elapsed;
+	do {
+		if (!track.writePoints(path)) {
+			fprintf(stderr, "write failed: %s\n", track.lastError.c_str());
+			return;
+		}
+		ops += 1;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+
+	MappedFile written;
+	if (!written.open(path)) {
+		fprintf(stderr, "can't open %s to see how big it is\n", path);
+		return;
+	}
+	double bytes = (double)written.size();
+	written.close();
+
+	report("write", format, n, ops, elapsed, "bytes", ops * bytes / elapsed);
+
+	CTrack loaded;
+	ops = 0;
+	start = now();
+	do {
+		if (!loaded.readPoints(path)) {
+			fprintf(stderr, "read failed: %s\n", loaded.lastError.c_str());
+			return;
+		}
+		ops += 1;
+		elapsed = now() - start;
+	} while (elapsed < minSeconds);
+	sink = loaded.points.back().pos.x;
+
+	report("read", format, n, ops, elapsed, "bytes", ops * bytes / elapsed);
+
+	remove(path);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int main(int argc, char** argv)
+//============================================================================
+{
+	int maxPoints = maxTrackPoints;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+			out = fopen(argv[++i], "w");
+			if (!out) {
+				fprintf(stderr, "Can't open %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "-quick"))
+			minSeconds = 0.02;
+		else if (!strcmp(argv[i], "-max") && i + 1 < argc)
+			maxPoints = atoi(argv[++i]);
+		else {
+			fprintf(stderr, "usage: %s [-o file] [-quick] [-max N]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	// 4, 16, 64, ... and the largest track we can read
+	std::vector<int> sizes;
+	for (int n = 4; n < maxPoints && n < maxTrackPoints; n *= 4)
+		sizes.push_back(n);
+	sizes.push_back(maxPoints < maxTrackPoints ? maxPoints : maxTrackPoints);
+
+	// a thread per core for the _mt cases - and never fewer than 4, or the
+	// parallel check would only be comparing the serial path with itself
+	WorkPool pool(std::max(4, (int)std::thread::hardware_concurrency()));
+
+	CTrack track;
+	for (size_t s = 0; s < sizes.size(); s++) {
+		int n = sizes[s];
+		makeTrack(track, n);
+
+		for (int type = SPLINE_LINEAR; type <= SPLINE_BSPLINE; type++) {
+			SplineType st = (SplineType)type;
+			checkBatch(track, st, n);
+			benchBuild(track, st, n);
+			benchEval(track, st, n);
+			benchReference(track, st, n);
+			benchBatch(track, st, n);
+			benchArcLength(track, st, n);
+			benchFrames(track, st, n);
+			checkForward(track, st, n, 100);
+			checkParallel(track, st, n, pool);
+			benchTessellate(track, st, n, 10, TESSELLATE_BATCH);
+			benchTessellate(track, st, n, 10, TESSELLATE_FORWARD);
+			benchAdaptive(track, st, n);
+			benchFrames(track, st, n, &pool);
+			benchTessellate(track, st, n, 10, TESSELLATE_BATCH, &pool);
+			benchAdaptive(track, st, n, &pool);
+			benchDrag(track, st, n);
+		}
+
+		benchFiles(track, n, "TrackBench.txt", "text");
+		benchFiles(track, n, "TrackBench.trk", "binary");
+		benchSnapshot(track, n);
+		benchPick(track, n);
+	}
+
+	for (int cars = 100; cars <= 100000; cars *= 10) {
+		benchAdvance(track, cars);
+		benchCarFrames(track, cars);
+	}
+
+	// an ordinary sized hilly track for the physics (the cars can overlap
+	// - they don't run into each other)
+	makeTrack(track, 64);
+	for (int cars = 100; cars <= 100000; cars *= 10)
+		benchPhysics(track, cars);
+
+	// picking is meant to stay quick well past what a file can hold
+	if (maxPoints >= maxTrackPoints) {
+		makeTrack(track, 100000);
+		benchPick(track, 100000);
+	}
+
+	if (out != stdout)
+		fclose(out);
+	return disagreed ? 2 : 0;
+}
@@ -0,0 +1,308 @@
+/************************************************************************
+     File:        BoxInstances.cpp
+
+     Comment:     Lots of copies of one box, in one draw
+
+						See BoxInstances.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <stddef.h>
+#include <string.h>
+
+// we will need OpenGL, and OpenGL needs windows.h (on Windows - these
+// also build elsewhere for Benchmark/RenderCheck.cpp)
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <glad/glad.h>
+
+#include "BoxInstances.H"
+
+// one vertex of the box
+struct BoxVertex {
+	float pos[3];
+	float normal[3];
+	unsigned char color[4];
+};
+
+// the faces in BoxFace order - the normal, and the corners as which of
+// lo (0) or hi (1) each coordinate comes from
+struct BoxFaceCorners {
+	float normal[3];
+	int corner[4][3];
+};
+
+static const BoxFaceCorners boxFaces[6] = {
+	{ { 0,-1, 0}, {{0,0,0}, {1,0,0}, {1,0,1}, {0,0,1}} },	// bottom
+	{ { 0, 1, 0}, {{0,1,0}, {1,1,0}, {1,1,1}, {0,1,1}} },	// top
+	{ {-1, 0, 0}, {{0,1,0}, {0,1,1}, {0,0,1}, {0,0,0}} },	// back
+	{ { 1, 0, 0}, {{1,1,0}, {1,1,1}, {1,0,1}, {1,0,0}} },	// front
+	{ { 0, 0, 1}, {{0,1,1}, {1,1,1}, {1,0,1}, {0,0,1}} },	// right
+	{ { 0, 0,-1}, {{0,1,0}, {1,1,0}, {1,0,0}, {0,0,0}} }	// left
+};
+
+static const int boxVertices = 24;
+
+// put the box into its frame, and do the same lighting the fixed function
+// pipeline would (directional lights, color material for ambient and
+// diffuse) - with light 0's diffuse kept apart, so the shadow map can
+// take it away (see ShadowMap.H)
+static const char* boxVertexShader =
+	"#version 330 compatibility\n"
+	"layout(location = 0) in vec3 corner;\n"
+	"layout(location = 1) in vec3 normal;\n"
+	"layout(location = 2) in vec4 color;\n"
+	"layout(location = 3) in vec3 boxPos;\n"
+	"layout(location = 4) in vec3 boxU;\n"
+	"layout(location = 5) in vec3 boxV;\n"
+	"layout(location = 6) in vec3 boxW;\n"
+	"uniform int numLights;\n"
+	"uniform mat4 shadowMatrix;\n"
+	"out vec4 baseColor;\n"
+	"out vec4 sunColor;\n"
+	"out vec4 shadowCoord;\n"
+	"void main()\n"
+	"{\n"
+	"	mat3 frame = mat3(boxU, boxV, boxW);\n"
+	"	vec4 eye = gl_ModelViewMatrix * vec4(boxPos + frame * corner, 1.0);\n"
+	"	gl_Position = gl_ProjectionMatrix * eye;\n"
+	"	shadowCoord = shadowMatrix * eye;\n"
+	"	vec3 n = normalize(gl_NormalMatrix * (frame * normal));\n"
+	"	vec3 c = gl_LightModel.ambient.rgb * color.rgb;\n"
+	"	vec3 sun = vec3(0.0);\n"
+	"	for (int i = 0; i < numLights; i++) {\n"
+	"		vec3 l = normalize(gl_LightSource[i].position.xyz);\n"
+	"		vec3 d = max(dot(n, l), 0.0) * gl_LightSource[i].diffuse.rgb * color.rgb;\n"
+	"		c += gl_LightSource[i].ambient.rgb * color.rgb;\n"
+	"		if (i == 0)\n"
+	"			sun = d;\n"
+	"		else\n"
+	"			c += d;\n"
+	"	}\n"
+	"	baseColor = vec4(c, color.a);\n"
+	"	sunColor = vec4(sun, 0.0);\n"
+	"}\n";
+
+// for the ID buffer - each box is its own object
+static const char* boxIdVertexShader =
+	"#version 330 compatibility\n"
+	"layout(location = 0) in vec3 corner;\n"
+	"layout(location = 3) in vec3 boxPos;\n"
+	"layout(location = 4) in vec3 boxU;\n"
+	"layout(location = 5) in vec3 boxV;\n"
+	"layout(location = 6) in vec3 boxW;\n"
+	"layout(location = 7) in float boxT;\n"
+	"uniform uint objectId;\n"
+	"flat out uint pickId;\n"
+	"out float pickT;\n"
+	"void main()\n"
+	"{\n"
+	"	mat3 frame = mat3(boxU, boxV, boxW);\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * vec4(boxPos + frame * corner, 1.0);\n"
+	"	pickId = objectId + uint(gl_InstanceID);\n"
+	"	pickT = boxT;\n"
+	"}\n";
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+BoxInstances::
+BoxInstances(const float lo[3], const float hi[3], const unsigned char colors[6][4])
+	: count(0), vao(0), boxVbo(0), instanceVbo(0), numLightsLoc(-1)
+//============================================================================
+{
+	memcpy(this->lo, lo, sizeof(this->lo));
+	memcpy(this->hi, hi, sizeof(this->hi));
+	memcpy(this->colors, colors, sizeof(this->colors));
+}
+
+//****************************************************************************
+//
+// * the box never changes, so it goes up right away. the frames come
+//   later (upload)
+//============================================================================
+void BoxInstances::
+createGL()
+//============================================================================
+{
+	BoxVertex box[boxVertices];
+	for (int f = 0; f < 6; f++) {
+		for (int c = 0; c < 4; c++) {
+			BoxVertex& bv = box[f * 4 + c];
+			for (int a = 0; a < 3; a++) {
+				bv.pos[a] = boxFaces[f].corner[c][a] ? hi[a] : lo[a];
+				bv.normal[a] = boxFaces[f].normal[a];
+			}
+			memcpy(bv.color, colors[f], sizeof(bv.color));
+		}
+	}
+
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &boxVbo);
+	glGenBuffers(1, &instanceVbo);
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, boxVbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(box), box, GL_STATIC_DRAW);
+
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(BoxVertex),
+		(const void*)offsetof(BoxVertex, pos));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(BoxVertex),
+		(const void*)offsetof(BoxVertex, normal));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(BoxVertex),
+		(const void*)offsetof(BoxVertex, color));
+
+	// one frame per box
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+	for (GLuint a = 0; a < 4; a++) {
+		glEnableVertexAttribArray(3 + a);
+		glVertexAttribPointer(3 + a, 3, GL_FLOAT, GL_FALSE, sizeof(BoxInstance),
+			(const void*)(offsetof(BoxInstance, pos) + a * 3 * sizeof(float)));
+		glVertexAttribDivisor(3 + a, 1);
+	}
+	glEnableVertexAttribArray(7);
+	glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(BoxInstance),
+		(const void*)offsetof(BoxInstance, t));
+	glVertexAttribDivisor(7, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	shader.build(boxVertexShader, shadowFragmentShader);
+	numLightsLoc = shader.uniform("numLights");
+	idShader.build(boxIdVertexShader, idFragmentShader);
+	count = 0;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void BoxInstances::
+releaseGL()
+//============================================================================
+{
+	if (vao) {
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &boxVbo);
+		glDeleteBuffers(1, &instanceVbo);
+	}
+	shader.release();
+	idShader.release();
+	abandonGL();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void BoxInstances::
+abandonGL()
+//============================================================================
+{
+	vao = boxVbo = instanceVbo = 0;
+	count = 0;
+	shader.abandon();
+	idShader.abandon();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void BoxInstances::
+upload(const std::vector<BoxInstance>& instances)
+//============================================================================
+{
+	upload(instances.empty() ? 0 : &instances[0], instances.size());
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void BoxInstances::
+upload(const BoxInstance* instances, size_t n)
+//============================================================================
+{
+	if (!vao)
+		return;
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+	glBufferData(GL_ARRAY_BUFFER, n * sizeof(BoxInstance), n ? instances : 0, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	count = n;
+}
+
+//****************************************************************************
+//
+// * only inside what was sent last time
+//============================================================================
+void BoxInstances::
+uploadRange(size_t first, size_t n, const BoxInstance* instances)
+//============================================================================
+{
+	if (!vao || !n || first + n > count)
+		return;
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+	glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(BoxInstance),
+		n * sizeof(BoxInstance), instances);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+//****************************************************************************
+//
+// * all of them in one go
+//============================================================================
+void BoxInstances::
+draw(const ShadowMap* shadows) const
+//============================================================================
+{
+	if (!shader.isValid() || !count)
+		return;
+
+	GLint previous = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+
+	shader.use();
+	if (shadows)
+		shadows->applyTo(shader);
+	else
+		glUniform1i(shader.uniform("shadows"), 0);
+	// the view turns off lights 1 and 2 for the top camera
+	glUniform1i(numLightsLoc, glIsEnabled(GL_LIGHT1) ? 3 : 1);
+
+	glBindVertexArray(vao);
+	glDrawArraysInstanced(GL_QUADS, 0, boxVertices, (GLsizei)count);
+	glBindVertexArray(0);
+
+	glUseProgram(previous);
+}
+
+//****************************************************************************
+//
+// * the ID buffer's program is current again afterwards
+//============================================================================
+void BoxInstances::
+drawIds(const IdBuffer& ids, PickKind kind, int firstIndex) const
+//============================================================================
+{
+	if (!idShader.isValid() || !count)
+		return;
+
+	idShader.use();
+	glUniform1ui(idShader.uniform("objectId"), pickId(kind, firstIndex));
+	glUniform1i(idShader.uniform("addSegment"), 0);
+
+	glBindVertexArray(vao);
+	glDrawArraysInstanced(GL_QUADS, 0, boxVertices, (GLsizei)count);
+	glBindVertexArray(0);
+
+	ids.program().use();
+}
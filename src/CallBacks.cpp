@@ -20,7 +20,6 @@
 *************************************************************************/
 #pragma once
 
-#include <time.h>
 #include <math.h>
 
 #include "TrainWindow.H"
@@ -31,6 +30,7 @@
 #pragma warning(disable:4312)
 #pragma warning(disable:4311)
 #include <Fl/Fl_File_Chooser.H>
+#include <Fl/fl_ask.H>
 #include <Fl/math.h>
 #pragma warning(pop)
 
@@ -42,8 +42,8 @@ void resetCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
 {
 	tw->m_Track.resetPoints();
+	tw->simulation.restart();
 	tw->trainView->selectedCube = -1;
-	tw->m_Track.trainU = 0;
 	tw->damageMe();
 }
 
@@ -73,14 +73,10 @@ void addPointCB(Fl_Widget*, TrainWindow* tw)
 	size_t previdx = (newidx + npts -1) % npts;
 	Pnt3f npos = (tw->m_Track.points[previdx].pos + tw->m_Track.points[newidx].pos) * .5f;
 
-	tw->m_Track.points.insert(tw->m_Track.points.begin() + newidx,npos);
+	tw->m_Track.insertPoint(newidx, npos);
 
-	// make it so that the train doesn't move - unless its affected by this control point
-	// it should stay between the same points
-	if (ceil(tw->m_Track.trainU) > ((float)newidx)) {
-		tw->m_Track.trainU += 1;
-		if (tw->m_Track.trainU >= npts) tw->m_Track.trainU -= npts;
-	}
+	// the trains stay the same fraction of the way around the (now
+	// longer) track - see TrainSet::fit
 
 	tw->damageMe();
 }
@@ -94,9 +90,9 @@ void deletePointCB(Fl_Widget*, TrainWindow* tw)
 {
 	if (tw->m_Track.points.size() > 4) {
 		if (tw->trainView->selectedCube >= 0) {
-			tw->m_Track.points.erase(tw->m_Track.points.begin() + tw->trainView->selectedCube);
+			tw->m_Track.erasePoint(tw->trainView->selectedCube);
 		} else
-			tw->m_Track.points.pop_back();
+			tw->m_Track.erasePoint(tw->m_Track.points.size() - 1);
 	}
 	tw->damageMe();
 }
@@ -122,25 +118,63 @@ void backCB(Fl_Widget*, TrainWindow* tw)
 
 
 
-static unsigned long lastRedraw = 0;
 //***************************************************************************
 //
-// * Callback for idling - if things are sitting, this gets called
-// if the run button is pushed, then we need to make the train go.
-// This is taken from the old "RunButton" demo.
-// another nice problem to have - most likely, we'll be too fast
-// don't draw more than 30 times per second
+// * The run button - start or stop the simulation's clock. when it's off
+// the simulation thread sleeps, so we don't burn any CPU
 //===========================================================================
-void runButtonCB(TrainWindow* tw)
+void runButtonCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
 {
-	if (tw->runButton->value()) {	// only advance time if appropriate
-		if (clock() - lastRedraw > CLOCKS_PER_SEC/30) {
-			lastRedraw = clock();
-			tw->advanceTrain();
-			tw->damageMe();
-		}
-	}
+	if (tw->runButton->value())
+		tw->startRunning();
+	else
+		tw->stopRunning();
+	tw->damageMe();
+}
+
+//***************************************************************************
+//
+// * The simulation published where the trains are - this is on its
+//   thread, so all it can do is ask the FlTk thread to redraw
+//===========================================================================
+void simulationCB(void* tw)
+//===========================================================================
+{
+	Fl::awake(redrawCB, tw);
+}
+
+//***************************************************************************
+//
+// * ... which it does here, the next time it looks
+//===========================================================================
+void redrawCB(void* tw)
+//===========================================================================
+{
+	((TrainWindow*)tw)->trainView->damage(1);
+}
+
+//***************************************************************************
+//
+// * The tension slider - the track picks the new value up the next time
+//   the cardinal spline is used
+//===========================================================================
+void tensionCB(Fl_Widget*, TrainWindow* tw)
+//===========================================================================
+{
+	tw->m_Track.tension = (float)tw->tension->value();
+	tw->damageMe();
+}
+
+//***************************************************************************
+//
+// * a different number of trains or cars - start them all over
+//===========================================================================
+void trainsCB(Fl_Widget*, TrainWindow* tw)
+//===========================================================================
+{
+	tw->simulation.makeTrains((int)tw->numTrains->value(), (int)tw->carsPerTrain->value());
+	tw->damageMe();
 }
 
 //***************************************************************************
@@ -151,9 +185,12 @@ void loadCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
 {
 	const char* fname = 
-		fl_file_chooser("Pick a Track File","*.txt","TrackFiles/track.txt");
+		fl_file_chooser("Pick a Track File","*.{txt,trk}","TrackFiles/track.txt");
 	if (fname) {
-		tw->m_Track.readPoints(fname);
+		if (tw->m_Track.readPoints(fname))
+			tw->simulation.restart();
+		else
+			fl_alert("%s", tw->m_Track.lastError.c_str());
 		tw->damageMe();
 	}
 }
@@ -165,9 +202,9 @@ void saveCB(Fl_Widget*, TrainWindow* tw)
 //===========================================================================
 {
 	const char* fname = 
-		fl_input("File name for save (should be *.txt)","TrackFiles/");
-	if (fname)
-		tw->m_Track.writePoints(fname);
+		fl_input("File name for save (*.txt, or *.trk for binary)","TrackFiles/");
+	if (fname && !tw->m_Track.writePoints(fname))
+		fl_alert("%s", tw->m_Track.lastError.c_str());
 }
 
 //***************************************************************************
@@ -183,6 +220,7 @@ void rollx(TrainWindow* tw, float dir)
 		float co = cos(((float)M_PI_4) * dir);
 		tw->m_Track.points[s].orient.y = co * old.y - si * old.z;
 		tw->m_Track.points[s].orient.z = si * old.y + co * old.z;
+		tw->m_Track.pointChanged(s);
 	}
 	tw->damageMe();
 } 
@@ -223,6 +261,7 @@ void rollz(TrainWindow* tw, float dir)
 
 		tw->m_Track.points[s].orient.y = co * old.y - si * old.x;
 		tw->m_Track.points[s].orient.x = si * old.y + co * old.x;
+		tw->m_Track.pointChanged(s);
 	}
 
 	tw->damageMe();
@@ -0,0 +1,163 @@
+/************************************************************************
+     File:        Floor.cpp
+
+     Comment:     The ground, as one quad
+
+						See Floor.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+// we will need OpenGL, and OpenGL needs windows.h (on Windows - these
+// also build elsewhere for Benchmark/RenderCheck.cpp)
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <glad/glad.h>
+
+#include "Floor.H"
+#include "Utilities/3DUtils.h"
+
+// the quad is -1..1 in x and z - the shader scales it to the size
+static const float corners[4][2] = { {-1,-1}, {-1, 1}, { 1, 1}, { 1,-1} };
+
+// cell is where we are in units of squares (from the corner, like
+// drawFloor counts them)
+static const char* floorVertexShader =
+	"#version 330 compatibility\n"
+	"layout(location = 0) in vec2 corner;\n"
+	"uniform float halfSize;\n"
+	"uniform float squareSize;\n"
+	"uniform mat4 shadowMatrix;\n"
+	"out vec2 cell;\n"
+	"out vec4 shadowCoord;\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 xz = corner * halfSize;\n"
+	"	vec4 eye = gl_ModelViewMatrix * vec4(xz.x, 0.0, xz.y, 1.0);\n"
+	"	gl_Position = gl_ProjectionMatrix * eye;\n"
+	"	shadowCoord = shadowMatrix * eye;\n"
+	"	cell = (xz + halfSize) / squareSize;\n"
+	"}\n";
+
+// the checkerboard is a square wave in x times one in z. each is
+// averaged over the pixel's footprint (the integral of a square wave
+// is a triangle wave), so far away squares blend rather than alias.
+// unlit, and half as bright in the shadow
+static const char* floorFragmentShader =
+	"#version 330 compatibility\n"
+	SHADOW_LOOKUP_GLSL
+	"uniform vec3 color1;\n"
+	"uniform vec3 color2;\n"
+	"in vec2 cell;\n"
+	"in vec4 shadowCoord;\n"
+	"out vec4 fragColor;\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 w = fwidth(cell) + 0.0001;\n"
+	"	vec2 i = 2.0 * (abs(fract((cell - 0.5 * w) * 0.5) - 0.5) -\n"
+	"					abs(fract((cell + 0.5 * w) * 0.5) - 0.5)) / w;\n"
+	"	float odd = 0.5 - 0.5 * i.x * i.y;\n"
+	"	vec3 c = mix(color2, color1, odd);\n"
+	"	fragColor = vec4(c * (0.5 + 0.5 * shadowLight(shadowCoord)), 1.0);\n"
+	"}\n";
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+Floor::
+Floor(float size, float squareSize)
+	: size(size), squareSize(squareSize),
+	  vao(0), vbo(0),
+	  halfSizeLoc(-1), squareSizeLoc(-1), color1Loc(-1), color2Loc(-1)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void Floor::
+createGL()
+//============================================================================
+{
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	shader.build(floorVertexShader, floorFragmentShader);
+	halfSizeLoc = shader.uniform("halfSize");
+	squareSizeLoc = shader.uniform("squareSize");
+	color1Loc = shader.uniform("color1");
+	color2Loc = shader.uniform("color2");
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void Floor::
+releaseGL()
+//============================================================================
+{
+	if (vao) {
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &vbo);
+	}
+	shader.release();
+	abandonGL();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void Floor::
+abandonGL()
+//============================================================================
+{
+	vao = vbo = 0;
+	shader.abandon();
+}
+
+//****************************************************************************
+//
+// * the program is put back the way it was
+//============================================================================
+void Floor::
+draw(const ShadowMap* shadows)
+//============================================================================
+{
+	if (!vao || !shader.isValid())
+		return;
+
+	GLint previous = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+
+	shader.use();
+	if (shadows)
+		shadows->applyTo(shader);
+	else
+		glUniform1i(shader.uniform("shadows"), 0);
+	glUniform1f(halfSizeLoc, size / 2);
+	glUniform1f(squareSizeLoc, squareSize);
+	glUniform3fv(color1Loc, 1, floorColor1);
+	glUniform3fv(color2Loc, 1, floorColor2);
+
+	glBindVertexArray(vao);
+	glDrawArrays(GL_QUADS, 0, 4);
+	glBindVertexArray(0);
+
+	glUseProgram(previous);
+}
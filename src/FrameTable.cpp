@@ -0,0 +1,314 @@
+/************************************************************************
+     File:        FrameTable.cpp
+
+     Comment:     The frames along the track, worked out ahead of time
+
+						See FrameTable.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "FrameTable.H"
+#include "Tessellate.H"
+#include "WorkPool.H"
+
+//****************************************************************************
+//
+// * helper for the dot product
+//============================================================================
+static float dot(const Pnt3f& a, const Pnt3f& b)
+//============================================================================
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+//****************************************************************************
+//
+// * the frame at the end of a segment, from the spline's direction and up
+//   vector there. if the up vector points along the track there's no roll
+//   to be had from it, so use whichever axis is furthest from the track
+//============================================================================
+static void knotFrame(const Pnt3f& dir, const Pnt3f& up, Pnt3f& u, Pnt3f& v, Pnt3f& w)
+//============================================================================
+{
+	Pnt3f side = dir * up;
+	if (dot(side, side) > 1e-6f) {
+		trackFrame(dir, up, u, v, w);
+		return;
+	}
+
+	float ax = fabsf(dir.x), ay = fabsf(dir.y), az = fabsf(dir.z);
+	Pnt3f axis(0, 1, 0);
+	if (ax <= ay && ax <= az)
+		axis = Pnt3f(1, 0, 0);
+	else if (az <= ay)
+		axis = Pnt3f(0, 0, 1);
+	trackFrame(dir, axis, u, v, w);
+}
+
+//****************************************************************************
+//
+// * how many frames segment i gets (one more than its pieces)
+//============================================================================
+static size_t segmentFrames(const ArcLengthTable& arc, size_t i)
+//============================================================================
+{
+	int pieces = (int)ceilf(arc.segmentLength(i) / frameSpacing);
+	pieces = std::max(frameMinPieces, std::min(frameMaxPieces, pieces));
+	return (size_t)pieces + 1;
+}
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+FrameTable::
+FrameTable() : builtFrom((unsigned long)-1)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * the frames of one segment. carry the frame at the start along the
+//   curve by double reflection: reflect it in the plane halfway between
+//   one sample and the next, which gets the position right but the
+//   tangent flipped about, then reflect again to line the tangent back
+//   up. then turn them all (a bit more each step) so the last one ends up
+//   with the roll at the end of the segment
+//============================================================================
+void FrameTable::
+buildSegment(const SplineCache& spline, const ArcLengthTable& arc, size_t i, size_t first)
+//============================================================================
+{
+	float len = arc.segmentLength(i);
+	int pieces = (int)segmentFrames(arc, i) - 1;
+
+	Pnt3f pos, dir, splineUp;
+	Pnt3f u, v, w;
+	spline.evalLocal(i, 0, pos, dir, splineUp);
+	knotFrame(dir, splineUp, u, v, w);
+
+	param[first] = 0;
+	along[first] = u;
+	up[first] = v;
+	across[first] = w;
+
+	for (int j = 1; j <= pieces; j++) {
+		float s = (j == pieces) ? 1.0f :
+			arc.segmentParameter(i, (double)len * j / pieces);
+
+		Pnt3f nextPos, nextDir;
+		spline.evalLocal(i, s, nextPos, nextDir, splineUp);
+
+		Pnt3f r = v;
+		Pnt3f t = u;
+		Pnt3f v1 = nextPos - pos;
+		float c1 = dot(v1, v1);
+		if (c1 > 1e-12f) {
+			r = r - v1 * (2.0f / c1 * dot(v1, r));
+			t = t - v1 * (2.0f / c1 * dot(v1, t));
+		}
+		Pnt3f v2 = nextDir - t;
+		float c2 = dot(v2, v2);
+		if (c2 > 1e-12f)
+			r = r - v2 * (2.0f / c2 * dot(v2, r));
+
+		// straighten out the rounding
+		trackFrame(nextDir, r, u, v, w);
+
+		param[first + j] = s;
+		along[first + j] = u;
+		up[first + j] = v;
+		across[first + j] = w;
+		pos = nextPos;
+	}
+
+	// where the roll has to end up
+	Pnt3f endU, endV, endW;
+	knotFrame(u, splineUp, endU, endV, endW);
+	float roll = atan2f(dot(v * endV, u), dot(v, endV));
+
+	for (int j = 1; j < pieces; j++) {
+		float a = roll * (float)j / (float)pieces;
+		float c = cosf(a), sn = sinf(a);
+		Pnt3f rv = up[first + j], rw = across[first + j];
+		up[first + j] = rv * c + rw * sn;
+		across[first + j] = rw * c - rv * sn;
+	}
+	up[first + pieces] = endV;
+	across[first + pieces] = endW;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void FrameTable::
+resize(size_t n)
+//============================================================================
+{
+	param.resize(n);
+	along.resize(n);
+	up.resize(n);
+	across.resize(n);
+}
+
+//****************************************************************************
+//
+// * bring the table up to date - only the segments that changed since the
+//   last build get new frames. if they have as many as before they go
+//   right over the old ones, otherwise the table is put back together
+//============================================================================
+void FrameTable::
+build(const SplineCache& spline, const ArcLengthTable& arc, WorkPool* pool)
+//============================================================================
+{
+	if (spline.version() == builtFrom)
+		return;
+	unsigned long since = builtFrom;
+	builtFrom = spline.version();
+
+	size_t n = spline.size();
+	if (since == (unsigned long)-1 || segmentFirst.size() != n + 1) {
+		segmentFirst.resize(n + 1);
+		segmentFirst[0] = 0;
+		for (size_t i = 0; i < n; i++)
+			segmentFirst[i + 1] = segmentFirst[i] + segmentFrames(arc, i);
+		resize(segmentFirst[n]);
+
+		auto segments = [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; i++)
+				buildSegment(spline, arc, i, segmentFirst[i]);
+		};
+		if (pool)
+			pool->run(n, tessellateChunk, segments);
+		else
+			segments(0, n);
+		return;
+	}
+
+	// the new frames of the changed segments, one after the other
+	FrameTable fresh;
+	std::vector<size_t> changed;
+	bool sameCounts = true;
+	size_t total = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (spline.segmentVersion(i) <= since)
+			continue;
+		changed.push_back(i);
+		fresh.segmentFirst.push_back(total);
+		size_t count = segmentFrames(arc, i);
+		total += count;
+		if (count != segmentFirst[i + 1] - segmentFirst[i])
+			sameCounts = false;
+	}
+	fresh.segmentFirst.push_back(total);
+	fresh.resize(total);
+	for (size_t c = 0; c < changed.size(); c++)
+		fresh.buildSegment(spline, arc, changed[c], fresh.segmentFirst[c]);
+
+	if (sameCounts) {
+		for (size_t c = 0; c < changed.size(); c++) {
+			size_t from = fresh.segmentFirst[c];
+			size_t count = fresh.segmentFirst[c + 1] - from;
+			size_t at = segmentFirst[changed[c]];
+			std::copy(fresh.param.begin() + from, fresh.param.begin() + from + count, param.begin() + at);
+			std::copy(fresh.along.begin() + from, fresh.along.begin() + from + count, along.begin() + at);
+			std::copy(fresh.up.begin() + from, fresh.up.begin() + from + count, up.begin() + at);
+			std::copy(fresh.across.begin() + from, fresh.across.begin() + from + count, across.begin() + at);
+		}
+		return;
+	}
+
+	// some segment got more or fewer frames - everything after it moves
+	FrameTable whole;
+	whole.segmentFirst.resize(n + 1);
+	size_t c = 0;
+	for (size_t i = 0; i < n; i++) {
+		whole.segmentFirst[i] = whole.param.size();
+
+		const FrameTable* from = this;
+		size_t first = segmentFirst[i], last = segmentFirst[i + 1];
+		if (c < changed.size() && changed[c] == i) {
+			from = &fresh;
+			first = fresh.segmentFirst[c];
+			last = fresh.segmentFirst[c + 1];
+			c++;
+		}
+		whole.param.insert(whole.param.end(), from->param.begin() + first, from->param.begin() + last);
+		whole.along.insert(whole.along.end(), from->along.begin() + first, from->along.begin() + last);
+		whole.up.insert(whole.up.end(), from->up.begin() + first, from->up.begin() + last);
+		whole.across.insert(whole.across.end(), from->across.begin() + first, from->across.begin() + last);
+	}
+	whole.segmentFirst[n] = whole.param.size();
+
+	param.swap(whole.param);
+	along.swap(whole.along);
+	up.swap(whole.up);
+	across.swap(whole.across);
+	segmentFirst.swap(whole.segmentFirst);
+}
+
+//****************************************************************************
+//
+// * find the two frames either side of u and blend between them
+//============================================================================
+void FrameTable::
+frameAt(size_t i, float u, Pnt3f& fu, Pnt3f& fv, Pnt3f& fw) const
+//============================================================================
+{
+	if (i + 1 >= segmentFirst.size()) {
+		fu = Pnt3f(1, 0, 0);
+		fv = Pnt3f(0, 1, 0);
+		fw = Pnt3f(0, 0, 1);
+		return;
+	}
+
+	size_t first = segmentFirst[i];
+	size_t last = segmentFirst[i + 1] - 1;
+
+	// the frame at or before u (but not the very last one)
+	size_t k = std::upper_bound(param.begin() + first, param.begin() + last, u)
+				- param.begin();
+	k = (k > first) ? k - 1 : first;
+
+	float span = param[k + 1] - param[k];
+	float f = span > 0 ? (u - param[k]) / span : 0;
+	if (f < 0) f = 0;
+	if (f > 1) f = 1;
+
+	Pnt3f dir = along[k] * (1 - f) + along[k + 1] * f;
+	dir.normalize();
+	trackFrame(dir, up[k] * (1 - f) + up[k + 1] * f, fu, fv, fw);
+}
+
+//****************************************************************************
+//
+// * split the parameter into a segment and a local parameter the same way
+//   SplineCache::eval does
+//============================================================================
+void FrameTable::
+frameAt(float t, Pnt3f& u, Pnt3f& v, Pnt3f& w) const
+//============================================================================
+{
+	size_t n = segmentFirst.empty() ? 0 : segmentFirst.size() - 1;
+	if (!n) {
+		frameAt((size_t)0, 0.0f, u, v, w);
+		return;
+	}
+
+	t = fmodf(t, (float)n);
+	if (t < 0)
+		t += (float)n;
+
+	size_t i = (size_t)floorf(t);
+	if (i >= n)
+		i = n - 1;
+	frameAt(i, t - (float)i, u, v, w);
+}
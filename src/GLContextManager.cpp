@@ -0,0 +1,95 @@
+/************************************************************************
+     File:        GLContextManager.cpp
+
+     Comment:     Keeps track of the life of the GL context of a window
+
+						See GLContextManager.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <stdexcept>
+
+// we will need OpenGL, and OpenGL needs windows.h
+#include <windows.h>
+#include <glad/glad.h>
+
+#pragma warning(push)
+#pragma warning(disable:4312)
+#pragma warning(disable:4311)
+#include <Fl/Fl_Gl_Window.h>
+#pragma warning(pop)
+
+#include "GLContextManager.H"
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+GLContextManager::
+GLContextManager() : live(false), contexts(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void GLContextManager::
+add(GLResource* resource)
+//============================================================================
+{
+	resources.push_back(resource);
+}
+
+//****************************************************************************
+//
+// * only does any work when FlTk gives us a new context
+//============================================================================
+bool GLContextManager::
+begin(Fl_Gl_Window* window)
+//============================================================================
+{
+	if (window->context_valid() && live)
+		return false;
+
+	// whatever we had belonged to a context that doesn't exist anymore
+	if (live)
+		for (size_t i = 0; i < resources.size(); i++)
+			resources[i]->abandonGL();
+
+	if (!gladLoadGL())
+		throw std::runtime_error("Could not initialize GLAD!");
+
+	for (size_t i = 0; i < resources.size(); i++)
+		resources[i]->createGL();
+
+	live = true;
+	contexts++;
+	return true;
+}
+
+//****************************************************************************
+//
+// * delete everything while we still have the context to do it in
+//============================================================================
+void GLContextManager::
+release(Fl_Gl_Window* window)
+//============================================================================
+{
+	if (!live)
+		return;
+
+	if (window->context()) {
+		window->make_current();
+		for (size_t i = 0; i < resources.size(); i++)
+			resources[i]->releaseGL();
+	}
+	else
+		for (size_t i = 0; i < resources.size(); i++)
+			resources[i]->abandonGL();
+
+	live = false;
+}
@@ -0,0 +1,247 @@
+/************************************************************************
+     File:        IdBuffer.cpp
+
+     Comment:     Picking anything in the scene, by drawing IDs
+
+						See IdBuffer.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <string.h>
+
+// we will need OpenGL, and OpenGL needs windows.h (on Windows - these
+// also build elsewhere for Benchmark/RenderCheck.cpp)
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <glad/glad.h>
+
+#include "IdBuffer.H"
+
+// fixed function geometry - the ID is the same for the whole draw, and
+// t is generic attribute 7 (a constant, unless an array is turned on)
+static const char* idVertexShader =
+	"#version 330 compatibility\n"
+	"layout(location = 7) in float param;\n"
+	"uniform uint objectId;\n"
+	"flat out uint pickId;\n"
+	"out float pickT;\n"
+	"void main()\n"
+	"{\n"
+	"	gl_Position = ftransform();\n"
+	"	pickId = objectId;\n"
+	"	pickT = param;\n"
+	"}\n";
+
+// t goes out as its bits, so it comes back exactly
+const char* idFragmentShader =
+	"#version 330 compatibility\n"
+	"uniform bool addSegment;\n"
+	"flat in uint pickId;\n"
+	"in float pickT;\n"
+	"layout(location = 0) out uvec2 fragId;\n"
+	"void main()\n"
+	"{\n"
+	"	uint id = pickId;\n"
+	"	if (addSegment)\n"
+	"		id += uint(max(floor(pickT), 0.0));\n"
+	"	fragId = uvec2(id, floatBitsToUint(pickT));\n"
+	"}\n";
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+IdBuffer::
+IdBuffer()
+	: fbo(0), idRenderbuffer(0), depthRenderbuffer(0), pbo(0), fence(0),
+	  bufferWidth(0), bufferHeight(0), pickX(0), pickY(0),
+	  objectIdLoc(-1), addSegmentLoc(-1),
+	  savedFramebuffer(0), savedProgram(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * the renderbuffers get their storage when we know the window size
+//============================================================================
+void IdBuffer::
+createGL()
+//============================================================================
+{
+	glGenFramebuffers(1, &fbo);
+	glGenRenderbuffers(1, &idRenderbuffer);
+	glGenRenderbuffers(1, &depthRenderbuffer);
+	bufferWidth = bufferHeight = 0;
+
+	glGenBuffers(1, &pbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+	glBufferData(GL_PIXEL_PACK_BUFFER, 2 * sizeof(GLuint), 0, GL_STREAM_READ);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	shader.build(idVertexShader, idFragmentShader);
+	objectIdLoc = shader.uniform("objectId");
+	addSegmentLoc = shader.uniform("addSegment");
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void IdBuffer::
+releaseGL()
+//============================================================================
+{
+	if (fence)
+		glDeleteSync((GLsync)fence);
+	if (fbo) {
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteRenderbuffers(1, &idRenderbuffer);
+		glDeleteRenderbuffers(1, &depthRenderbuffer);
+		glDeleteBuffers(1, &pbo);
+	}
+	shader.release();
+	abandonGL();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void IdBuffer::
+abandonGL()
+//============================================================================
+{
+	fbo = idRenderbuffer = depthRenderbuffer = pbo = 0;
+	fence = 0;
+	bufferWidth = bufferHeight = 0;
+	shader.abandon();
+}
+
+//****************************************************************************
+//
+// * the buffer is the size of the window, so the view's matrices (and
+//   line widths) work as they are - but only the one pixel is cleared
+//   and drawn
+//============================================================================
+bool IdBuffer::
+begin(int x, int y, int width, int height)
+//============================================================================
+{
+	if (!fbo || !shader.isValid())
+		return false;
+
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &savedFramebuffer);
+	glGetIntegerv(GL_CURRENT_PROGRAM, &savedProgram);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	if (width != bufferWidth || height != bufferHeight) {
+		glBindRenderbuffer(GL_RENDERBUFFER, idRenderbuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RG32UI, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			GL_RENDERBUFFER, idRenderbuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+			GL_RENDERBUFFER, depthRenderbuffer);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		bufferWidth = width;
+		bufferHeight = height;
+	}
+	pickX = x;
+	pickY = y;
+
+	glPushAttrib(GL_ENABLE_BIT | GL_SCISSOR_BIT | GL_VIEWPORT_BIT | GL_LINE_BIT);
+	glViewport(0, 0, width, height);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(x, y, 1, 1);
+	glDisable(GL_BLEND);
+	glDisable(GL_LIGHTING);
+	glEnable(GL_DEPTH_TEST);
+
+	const GLuint nothing[4] = { 0, 0, 0, 0 };
+	glClearBufferuiv(GL_COLOR, 0, nothing);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	shader.use();
+	setObject(PICK_NOTHING, 0, 0);
+	return true;
+}
+
+//****************************************************************************
+//
+// * the read goes into the pixel buffer - the fence tells us when it's
+//   there. a pick that was still waiting is dropped
+//============================================================================
+void IdBuffer::
+end()
+//============================================================================
+{
+	if (fence)
+		glDeleteSync((GLsync)fence);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+	glReadPixels(pickX, pickY, 1, 1, GL_RG_INTEGER, GL_UNSIGNED_INT, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	glPopAttrib();
+	glUseProgram(savedProgram);
+	glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+}
+
+//****************************************************************************
+//
+// * program() has to be the current program
+//============================================================================
+void IdBuffer::
+setObject(PickKind kind, int index, float t, bool bySegment) const
+//============================================================================
+{
+	glUniform1ui(objectIdLoc, pickId(kind, index));
+	glUniform1i(addSegmentLoc, bySegment);
+	glVertexAttrib1f(7, t);
+}
+
+//****************************************************************************
+//
+// * don't wait - if the GPU isn't done, try again later
+//============================================================================
+bool IdBuffer::
+poll(PickResult& result)
+//============================================================================
+{
+	if (!fence)
+		return false;
+
+	GLenum status = glClientWaitSync((GLsync)fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status == GL_TIMEOUT_EXPIRED)
+		return false;
+	glDeleteSync((GLsync)fence);
+	fence = 0;
+	if (status == GL_WAIT_FAILED)
+		return false;
+
+	GLuint pixel[2] = { 0, 0 };
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+	const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(pixel), GL_MAP_READ_BIT);
+	if (mapped) {
+		memcpy(pixel, mapped, sizeof(pixel));
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	result.kind = (PickKind)(pixel[0] >> pickKindShift);
+	result.index = (int)(pixel[0] & ((1u << pickKindShift) - 1));
+	memcpy(&result.t, &pixel[1], sizeof(float));
+	if (result.kind == PICK_NOTHING) {
+		result.index = -1;
+		result.t = 0;
+	}
+	return true;
+}
@@ -0,0 +1,285 @@
+/************************************************************************
+     File:        PickIndex.cpp
+
+     Comment:     Finding the control point under the mouse
+
+						See PickIndex.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+#include <float.h>
+
+#include <algorithm>
+
+#include "PickIndex.H"
+
+// one coordinate of a point, by number
+static float coord(const Pnt3f& p, int axis)
+{
+	return axis == 0 ? p.x : (axis == 1 ? p.y : p.z);
+}
+
+//****************************************************************************
+//
+// * where the ray goes into a box (clamped to the start of the ray), or
+//   false if it misses or only gets there after maxT
+//============================================================================
+static bool rayBox(const float origin[3], const float inverse[3],
+				   const float lo[3], const float hi[3], float maxT, float& enter)
+//============================================================================
+{
+	float t0 = 0, t1 = maxT;
+	for (int a = 0; a < 3; a++) {
+		float n = (lo[a] - origin[a]) * inverse[a];
+		float f = (hi[a] - origin[a]) * inverse[a];
+		if (n > f)
+			std::swap(n, f);
+		t0 = std::max(t0, n);
+		t1 = std::min(t1, f);
+		if (t0 > t1)
+			return false;
+	}
+	enter = t0;
+	return true;
+}
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+PickIndex::
+PickIndex()
+	: stale(true), moved(false)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void PickIndex::
+invalidate()
+//============================================================================
+{
+	stale = true;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void PickIndex::
+invalidatePoint(size_t i)
+//============================================================================
+{
+	if (i < centers.size())
+		moved = true;
+	else
+		stale = true;
+}
+
+//****************************************************************************
+//
+// * a moved point keeps its place in the tree - the boxes just grow or
+//   shrink around it, children before parents
+//============================================================================
+void PickIndex::
+build(const std::vector<ControlPoint>& points)
+//============================================================================
+{
+	if (!stale && !moved && points.size() == centers.size())
+		return;
+
+	centers.resize(points.size());
+	for (size_t i = 0; i < points.size(); i++)
+		centers[i] = points[i].pos;
+
+	if (!stale && points.size() == order.size()) {
+		for (int n = (int)nodes.size() - 1; n >= 0; n--)
+			fit(n);
+	}
+	else {
+		order.resize(points.size());
+		for (size_t i = 0; i < order.size(); i++)
+			order[i] = (int)i;
+
+		nodes.clear();
+		if (!order.empty()) {
+			nodes.reserve(2 * order.size() / pickLeafSize + 1);
+			nodes.push_back(Node());
+			split(0, 0, (int)order.size());
+		}
+	}
+
+	stale = moved = false;
+}
+
+//****************************************************************************
+//
+// * cut the points in half along the longest side of the box around
+//   their centers, until there are few enough for a leaf
+//============================================================================
+void PickIndex::
+split(int n, int first, int count)
+//============================================================================
+{
+	nodes[n].first = first;
+	nodes[n].count = count;
+	if (count <= pickLeafSize) {
+		fit(n);
+		return;
+	}
+
+	float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (int k = first; k < first + count; k++) {
+		const Pnt3f& c = centers[order[k]];
+		const float p[3] = { c.x, c.y, c.z };
+		for (int a = 0; a < 3; a++) {
+			lo[a] = std::min(lo[a], p[a]);
+			hi[a] = std::max(hi[a], p[a]);
+		}
+	}
+	int axis = 0;
+	for (int a = 1; a < 3; a++)
+		if (hi[a] - lo[a] > hi[axis] - lo[axis])
+			axis = a;
+
+	int half = count / 2;
+	const std::vector<Pnt3f>& at = centers;
+	std::nth_element(order.begin() + first, order.begin() + first + half,
+					 order.begin() + first + count,
+					 [&at, axis](int a, int b) { return coord(at[a], axis) < coord(at[b], axis); });
+
+	int child = (int)nodes.size();
+	nodes.resize(child + 2);
+	nodes[n].first = child;
+	nodes[n].count = 0;
+	split(child, first, half);
+	split(child + 1, first + half, count - half);
+	fit(n);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void PickIndex::
+fit(int n)
+//============================================================================
+{
+	Node& node = nodes[n];
+	for (int a = 0; a < 3; a++) {
+		node.lo[a] = FLT_MAX;
+		node.hi[a] = -FLT_MAX;
+	}
+
+	if (node.count) {
+		for (int k = node.first; k < node.first + node.count; k++) {
+			const Pnt3f& c = centers[order[k]];
+			const float p[3] = { c.x, c.y, c.z };
+			for (int a = 0; a < 3; a++) {
+				node.lo[a] = std::min(node.lo[a], p[a] - pickRadius);
+				node.hi[a] = std::max(node.hi[a], p[a] + pickRadius);
+			}
+		}
+	}
+	else {
+		for (int c = node.first; c < node.first + 2; c++)
+			for (int a = 0; a < 3; a++) {
+				node.lo[a] = std::min(node.lo[a], nodes[c].lo[a]);
+				node.hi[a] = std::max(node.hi[a], nodes[c].hi[a]);
+			}
+	}
+}
+
+//****************************************************************************
+//
+// * nearer child first, and nothing that starts past the best hit
+//============================================================================
+int PickIndex::
+pick(const Pnt3f& origin, const Pnt3f& dir) const
+//============================================================================
+{
+	if (nodes.empty())
+		return -1;
+
+	float length = sqrtf(dir.x * dir.x + dir.y * dir.y + dir.z * dir.z);
+	if (length <= 0)
+		return -1;
+	const float o[3] = { origin.x, origin.y, origin.z };
+	const float d[3] = { dir.x / length, dir.y / length, dir.z / length };
+
+	// a ray that doesn't move along an axis gets a huge inverse, so its
+	// slab is all or nothing
+	float inverse[3];
+	for (int a = 0; a < 3; a++)
+		inverse[a] = (d[a] != 0) ? 1.0f / d[a] : FLT_MAX;
+
+	int best = -1;
+	float bestT = FLT_MAX;
+
+	// the tree is balanced, so it's never deeper than this
+	int stack[64];
+	int depth = 0;
+	stack[depth++] = 0;
+
+	while (depth) {
+		const Node& node = nodes[stack[--depth]];
+		float enter;
+		if (!rayBox(o, inverse, node.lo, node.hi, bestT, enter))
+			continue;
+
+		if (node.count) {
+			// the spheres: |o + t d - c| = r, the smaller t (or the start
+			// of the ray, if it starts inside)
+			for (int k = node.first; k < node.first + node.count; k++) {
+				const Pnt3f& c = centers[order[k]];
+				float oc[3] = { o[0] - c.x, o[1] - c.y, o[2] - c.z };
+				float b = oc[0] * d[0] + oc[1] * d[1] + oc[2] * d[2];
+				float cc = oc[0] * oc[0] + oc[1] * oc[1] + oc[2] * oc[2] - pickRadius * pickRadius;
+				float disc = b * b - cc;
+				if (disc < 0)
+					continue;
+				float root = sqrtf(disc);
+				float t = -b - root;
+				if (t < 0) {
+					if (-b + root < 0)
+						continue;
+					t = 0;
+				}
+				if (t < bestT) {
+					bestT = t;
+					best = order[k];
+				}
+			}
+			continue;
+		}
+
+		// push the farther child first, so the nearer one comes off next
+		int left = node.first, right = node.first + 1;
+		float enterLeft, enterRight;
+		bool hitLeft = rayBox(o, inverse, nodes[left].lo, nodes[left].hi, bestT, enterLeft);
+		bool hitRight = rayBox(o, inverse, nodes[right].lo, nodes[right].hi, bestT, enterRight);
+		if (hitLeft && hitRight) {
+			if (enterLeft <= enterRight) {
+				stack[depth++] = right;
+				stack[depth++] = left;
+			}
+			else {
+				stack[depth++] = left;
+				stack[depth++] = right;
+			}
+		}
+		else if (hitLeft)
+			stack[depth++] = left;
+		else if (hitRight)
+			stack[depth++] = right;
+	}
+
+	return best;
+}
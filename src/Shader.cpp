@@ -0,0 +1,146 @@
+/************************************************************************
+     File:        Shader.cpp
+
+     Comment:     A GLSL program
+
+						See Shader.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <stdio.h>
+#include <vector>
+
+// we will need OpenGL, and OpenGL needs windows.h (on Windows - these
+// also build elsewhere for Benchmark/RenderCheck.cpp)
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <glad/glad.h>
+
+#include "Shader.H"
+
+//****************************************************************************
+//
+// * compile one stage - returns 0 (after printing the log) if it fails
+//============================================================================
+static GLuint compileStage(GLenum type, const char* source)
+//============================================================================
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, 0);
+	glCompileShader(shader);
+
+	GLint ok = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+	if (!ok) {
+		GLint len = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+		std::vector<char> log(len + 1);
+		glGetShaderInfoLog(shader, len, 0, &log[0]);
+		fprintf(stderr, "%s shader failed to compile:\n%s\n",
+			(type == GL_VERTEX_SHADER) ? "Vertex" : "Fragment", &log[0]);
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+ShaderProgram::
+ShaderProgram() : program(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool ShaderProgram::
+build(const char* vertexSource, const char* fragmentSource)
+//============================================================================
+{
+	release();
+
+	GLuint vs = compileStage(GL_VERTEX_SHADER, vertexSource);
+	GLuint fs = compileStage(GL_FRAGMENT_SHADER, fragmentSource);
+	if (!vs || !fs) {
+		glDeleteShader(vs);
+		glDeleteShader(fs);
+		return false;
+	}
+
+	program = glCreateProgram();
+	glAttachShader(program, vs);
+	glAttachShader(program, fs);
+	glLinkProgram(program);
+
+	// the program keeps what it needs
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	GLint ok = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &ok);
+	if (!ok) {
+		GLint len = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &len);
+		std::vector<char> log(len + 1);
+		glGetProgramInfoLog(program, len, 0, &log[0]);
+		fprintf(stderr, "Shader program failed to link:\n%s\n", &log[0]);
+		glDeleteProgram(program);
+		program = 0;
+		return false;
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void ShaderProgram::
+release()
+//============================================================================
+{
+	if (program)
+		glDeleteProgram(program);
+	program = 0;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void ShaderProgram::
+abandon()
+//============================================================================
+{
+	program = 0;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void ShaderProgram::
+use() const
+//============================================================================
+{
+	glUseProgram(program);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int ShaderProgram::
+uniform(const char* name) const
+//============================================================================
+{
+	return program ? glGetUniformLocation(program, name) : -1;
+}
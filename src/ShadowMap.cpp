@@ -0,0 +1,311 @@
+/************************************************************************
+     File:        ShadowMap.cpp
+
+     Comment:     Shadows from the main light, by shadow mapping
+
+						See ShadowMap.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+#include <string.h>
+
+// we will need OpenGL, and OpenGL needs windows.h (on Windows - these
+// also build elsewhere for Benchmark/RenderCheck.cpp)
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "ShadowMap.H"
+
+// the texture unit the depth map goes on (0 is left for everyone else)
+static const int shadowUnit = 1;
+
+// fixed function lighting (directional lights, color material for ambient
+// and diffuse), with light 0's diffuse kept apart for the shadow. with no
+// lights the color is used as it is - half of it in the shadow
+static const char* litVertexShader =
+	"#version 330 compatibility\n"
+	"uniform int numLights;\n"
+	"uniform mat4 shadowMatrix;\n"
+	"out vec4 baseColor;\n"
+	"out vec4 sunColor;\n"
+	"out vec4 shadowCoord;\n"
+	"void main()\n"
+	"{\n"
+	"	vec4 eye = gl_ModelViewMatrix * gl_Vertex;\n"
+	"	gl_Position = gl_ProjectionMatrix * eye;\n"
+	"	shadowCoord = shadowMatrix * eye;\n"
+	"	vec4 color = gl_Color;\n"
+	"	if (numLights == 0) {\n"
+	"		baseColor = vec4(0.5 * color.rgb, color.a);\n"
+	"		sunColor = vec4(0.5 * color.rgb, 0.0);\n"
+	"		return;\n"
+	"	}\n"
+	"	vec3 n = normalize(gl_NormalMatrix * gl_Normal);\n"
+	"	vec3 c = gl_LightModel.ambient.rgb * color.rgb;\n"
+	"	vec3 sun = vec3(0.0);\n"
+	"	for (int i = 0; i < numLights; i++) {\n"
+	"		vec3 l = normalize(gl_LightSource[i].position.xyz);\n"
+	"		vec3 d = max(dot(n, l), 0.0) * gl_LightSource[i].diffuse.rgb * color.rgb;\n"
+	"		c += gl_LightSource[i].ambient.rgb * color.rgb;\n"
+	"		if (i == 0)\n"
+	"			sun = d;\n"
+	"		else\n"
+	"			c += d;\n"
+	"	}\n"
+	"	baseColor = vec4(c, color.a);\n"
+	"	sunColor = vec4(sun, 0.0);\n"
+	"}\n";
+
+const char* shadowFragmentShader =
+	"#version 330 compatibility\n"
+	SHADOW_LOOKUP_GLSL
+	"in vec4 baseColor;\n"
+	"in vec4 sunColor;\n"
+	"in vec4 shadowCoord;\n"
+	"out vec4 fragColor;\n"
+	"void main()\n"
+	"{\n"
+	"	fragColor = baseColor + sunColor * shadowLight(shadowCoord);\n"
+	"}\n";
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+ShadowMap::
+ShadowMap()
+	: fbo(0), depthTexture(0), numLightsLoc(-1),
+	  haveDepth(false), lit(false), savedFramebuffer(0)
+//============================================================================
+{
+	memcpy(lightMatrix, glm::value_ptr(glm::mat4(1.0f)), sizeof(lightMatrix));
+	memcpy(lookup, lightMatrix, sizeof(lookup));
+	savedViewport[0] = savedViewport[1] = savedViewport[2] = savedViewport[3] = 0;
+}
+
+//****************************************************************************
+//
+// * the depth texture (compared as it's sampled), a framebuffer with
+//   nothing but it, and the shader for the main pass
+//============================================================================
+void ShadowMap::
+createGL()
+//============================================================================
+{
+	glGenTextures(1, &depthTexture);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, shadowMapSize, shadowMapSize,
+				 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	const GLfloat farAway[4] = { 1, 1, 1, 1 };
+	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, farAway);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLint previous = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+	if (!complete) {
+		releaseGL();
+		return;
+	}
+
+	litShader.build(litVertexShader, shadowFragmentShader);
+	numLightsLoc = litShader.uniform("numLights");
+	haveDepth = false;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void ShadowMap::
+releaseGL()
+//============================================================================
+{
+	if (fbo)
+		glDeleteFramebuffers(1, &fbo);
+	if (depthTexture)
+		glDeleteTextures(1, &depthTexture);
+	litShader.release();
+	abandonGL();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void ShadowMap::
+abandonGL()
+//============================================================================
+{
+	fbo = depthTexture = 0;
+	litShader.abandon();
+	haveDepth = false;
+	lit = false;
+}
+
+//****************************************************************************
+//
+// * look at the scene from the light. it's a directional light, so the
+//   projection is orthographic - just big enough to hold the sphere
+//============================================================================
+void ShadowMap::
+beginDepth(const Pnt3f& toLight, const Pnt3f& center, float radius)
+//============================================================================
+{
+	if (!fbo)
+		return;
+
+	glm::vec3 dir = glm::normalize(glm::vec3(toLight.x, toLight.y, toLight.z));
+	glm::vec3 at(center.x, center.y, center.z);
+
+	// any up will do, as long as it isn't along the light
+	glm::vec3 up = (fabsf(dir.y) < 0.99f) ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+
+	glm::mat4 view = glm::lookAt(at + dir * (2.0f * radius), at, up);
+	// the far side goes on past the sphere, so shadows falling on the
+	// floor below it still land in the map
+	glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, 5.0f * radius);
+	memcpy(lightMatrix, glm::value_ptr(projection * view), sizeof(lightMatrix));
+
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &savedFramebuffer);
+	glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_VIEWPORT_BIT | GL_POLYGON_BIT);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, shadowMapSize, shadowMapSize);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	// depth only - and pushed back a little, so surfaces don't shadow
+	// themselves
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDisable(GL_LIGHTING);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glEnable(GL_POLYGON_OFFSET_LINE);
+	glPolygonOffset(2.0f, 4.0f);
+
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadMatrixf(glm::value_ptr(projection));
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadMatrixf(glm::value_ptr(view));
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void ShadowMap::
+endDepth()
+//============================================================================
+{
+	if (!fbo)
+		return;
+
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+
+	glPopAttrib();
+	glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+	haveDepth = true;
+}
+
+//****************************************************************************
+//
+// * the shadow map is looked up from eye space: back to the world with
+//   the camera we're given, into the light's view, and from -1..1 to the
+//   0..1 of the texture
+//============================================================================
+void ShadowMap::
+beginLit(int numLights)
+//============================================================================
+{
+	if (!isValid())
+		return;
+
+	GLfloat camera[16];
+	glGetFloatv(GL_MODELVIEW_MATRIX, camera);
+
+	glm::mat4 bias = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) *
+					 glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+	glm::mat4 toShadow = bias * glm::make_mat4(lightMatrix) *
+						 glm::inverse(glm::make_mat4(camera));
+	memcpy(lookup, glm::value_ptr(toShadow), sizeof(lookup));
+
+	glActiveTexture(GL_TEXTURE0 + shadowUnit);
+	glBindTexture(GL_TEXTURE_2D, depthTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	lit = true;
+	litShader.use();
+	applyTo(litShader);
+	setLights(numLights);
+}
+
+//****************************************************************************
+//
+// * the lit shader has to be the current program
+//============================================================================
+void ShadowMap::
+setLights(int numLights)
+//============================================================================
+{
+	if (lit)
+		glUniform1i(numLightsLoc, numLights);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void ShadowMap::
+endLit()
+//============================================================================
+{
+	if (!lit)
+		return;
+
+	glUseProgram(0);
+	glActiveTexture(GL_TEXTURE0 + shadowUnit);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	lit = false;
+}
+
+//****************************************************************************
+//
+// * outside of beginLit/endLit (drawing the depth, say) the shadows are
+//   turned off
+//============================================================================
+void ShadowMap::
+applyTo(const ShaderProgram& program) const
+//============================================================================
+{
+	glUniformMatrix4fv(program.uniform("shadowMatrix"), 1, GL_FALSE, lookup);
+	glUniform1i(program.uniform("shadowMap"), shadowUnit);
+	glUniform1i(program.uniform("shadows"), lit && haveDepth);
+}
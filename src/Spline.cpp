@@ -0,0 +1,419 @@
+/************************************************************************
+     File:        Spline.cpp
+
+     Comment:     Cached spline evaluation for the track
+
+						See Spline.H. The basis matrices are the same ones
+						TrainView::getPnt3f used to multiply out for every
+						point, laid out the same way (one row per control
+						point, one column per power of t: t^3, t^2, t, 1).
+
+						Each basis is a type the folding code is compiled
+						for, so its entries are constants in there: the
+						type is switched on once per build, and folding a
+						segment is only the adds and multiplies its
+						nonzero entries need.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+
+#include "Spline.H"
+
+// The bases, one struct per spline type. Each entry of the basis matrix
+// (one row per control point, one column per power of t: t^3, t^2, t, 1)
+// is  fixed + perTension * tension,  with the 1/2 or 1/6 in front already
+// multiplied in. Only the cardinal spline has a tension - at 0.5 it's the
+// Catmull-Rom matrix the track has always used.
+//
+// posIdx and orientIdx say which control points (relative to the segment
+// start) go into the geometry array - these are the ones the original
+// evaluator picked, including the way it shifted the orientations
+
+// the linear "basis" only uses the first two control points
+struct LinearBasis {
+	static constexpr float fixed[4][4] = {
+		{ 0.0f,  0.0f, -1.0f,  1.0f },
+		{ 0.0f,  0.0f,  1.0f,  0.0f },
+		{ 0.0f,  0.0f,  0.0f,  0.0f },
+		{ 0.0f,  0.0f,  0.0f,  0.0f }
+	};
+	static constexpr float perTension[4][4] = {};
+	static constexpr int posIdx[4] = { 0, 1, 1, 1 };
+	static constexpr int orientIdx[4] = { 0, 1, 1, 1 };
+};
+
+struct CardinalBasis {
+	static constexpr float fixed[4][4] = {
+		{ 0.0f,  0.0f,  0.0f,  0.0f },
+		{ 2.0f, -3.0f,  0.0f,  1.0f },
+		{-2.0f,  3.0f,  0.0f,  0.0f },
+		{ 0.0f,  0.0f,  0.0f,  0.0f }
+	};
+	static constexpr float perTension[4][4] = {
+		{-1.0f,  2.0f, -1.0f,  0.0f },
+		{-1.0f,  1.0f,  0.0f,  0.0f },
+		{ 1.0f, -2.0f,  1.0f,  0.0f },
+		{ 1.0f, -1.0f,  0.0f,  0.0f }
+	};
+	static constexpr int posIdx[4] = {-1, 0, 1, 2 };
+	static constexpr int orientIdx[4] = { 0, 1, 2, 3 };
+};
+
+struct BSplineBasis {
+	static constexpr float fixed[4][4] = {
+		{-1.0f / 6.0f,  3.0f / 6.0f, -3.0f / 6.0f,  1.0f / 6.0f },
+		{ 3.0f / 6.0f, -6.0f / 6.0f,  0.0f,         4.0f / 6.0f },
+		{-3.0f / 6.0f,  3.0f / 6.0f,  3.0f / 6.0f,  1.0f / 6.0f },
+		{ 1.0f / 6.0f,  0.0f,         0.0f,         0.0f        }
+	};
+	static constexpr float perTension[4][4] = {};
+	static constexpr int posIdx[4] = {-1, 0, 1, 2 };
+	static constexpr int orientIdx[4] = {-1, 1, 2, 3 };
+};
+
+//****************************************************************************
+//
+// * one term of the fold: G[i] times basis entry (i,j). the entries are
+//   known when this is compiled, so the zeros disappear and the ones are
+//   just an add
+//============================================================================
+template <class B, int i, int j>
+static inline void addTerm(Pnt3f& sum, const Pnt3f G[4], float tension)
+//============================================================================
+{
+	constexpr float a = B::fixed[i][j];
+	constexpr float b = B::perTension[i][j];
+
+	if constexpr (b != 0.0f)
+		sum = sum + G[i] * (a + b * tension);
+	else if constexpr (a == 1.0f)
+		sum = sum + G[i];
+	else if constexpr (a == -1.0f)
+		sum = sum - G[i];
+	else if constexpr (a != 0.0f)
+		sum = sum + G[i] * a;
+}
+
+//****************************************************************************
+//
+// * the coefficient of one power of t: c[j] = sum_i M[i][j] G[i]
+//============================================================================
+template <class B, int j>
+static inline Pnt3f foldColumn(const Pnt3f G[4], float tension)
+//============================================================================
+{
+	Pnt3f sum;
+	addTerm<B, 0, j>(sum, G, tension);
+	addTerm<B, 1, j>(sum, G, tension);
+	addTerm<B, 2, j>(sum, G, tension);
+	addTerm<B, 3, j>(sum, G, tension);
+	return sum;
+}
+
+//****************************************************************************
+//
+// * fold the basis matrix into the geometry
+//============================================================================
+template <class B>
+static void foldBasis(const Pnt3f G[4], float tension, Pnt3f c[4])
+//============================================================================
+{
+	c[0] = foldColumn<B, 0>(G, tension);
+	c[1] = foldColumn<B, 1>(G, tension);
+	c[2] = foldColumn<B, 2>(G, tension);
+	c[3] = foldColumn<B, 3>(G, tension);
+}
+
+//****************************************************************************
+//
+// * fold the basis into the control points around segment i
+//============================================================================
+template <class B>
+static void foldSegment(const std::vector<ControlPoint>& points, float tension,
+						size_t i, SplineSegment& segment)
+//============================================================================
+{
+	int n = (int)points.size();
+
+	Pnt3f G[4];
+	for (int k = 0; k < 4; k++)
+		G[k] = points[((int)i + B::posIdx[k] + n) % n].pos;
+	foldBasis<B>(G, tension, segment.pos);
+
+	for (int k = 0; k < 4; k++)
+		G[k] = points[((int)i + B::orientIdx[k] + n) % n].orient;
+	foldBasis<B>(G, tension, segment.orient);
+}
+
+//****************************************************************************
+//
+// * the segments in the list (or all of them, if there's no list), with
+//   the basis picked once for the lot
+//============================================================================
+template <class B>
+static void foldSegments(const std::vector<ControlPoint>& points, float tension,
+						 const std::vector<size_t>* which, std::vector<SplineSegment>& segments)
+//============================================================================
+{
+	if (which) {
+		for (size_t k = 0; k < which->size(); k++)
+			foldSegment<B>(points, tension, (*which)[k], segments[(*which)[k]]);
+	}
+	else {
+		for (size_t i = 0; i < segments.size(); i++)
+			foldSegment<B>(points, tension, i, segments[i]);
+	}
+}
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+SplineCache::
+SplineCache() : valid(false), builds(0), builtTension(defaultTension)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void SplineCache::
+invalidate()
+//============================================================================
+{
+	valid = false;
+	dirty.clear();
+}
+
+//****************************************************************************
+//
+// * segment j uses control points j-1 .. j+2 for the position, and up to
+//   j+3 for the orientation (see the bases), so point i is in segments
+//   i-3 .. i+1
+//============================================================================
+void SplineCache::
+invalidatePoint(size_t i)
+//============================================================================
+{
+	size_t n = segments.size();
+	if (!valid || !n)
+		return;
+
+	// lots of little changes between builds - just do the lot
+	if (dirty.size() > n) {
+		invalidate();
+		return;
+	}
+
+	for (int d = -3; d <= 1; d++)
+		dirty.push_back((i + n + d) % n);
+}
+
+//****************************************************************************
+//
+// * compute the coefficients of every segment (if we need to) - or just
+//   the ones that a moved point touches
+//============================================================================
+void SplineCache::
+build(const std::vector<ControlPoint>& points, SplineType type, float tension)
+//============================================================================
+{
+	// a new tension changes every segment (only the cardinal has one)
+	if (type == SPLINE_CARDINAL && tension != builtTension) {
+		builtTension = tension;
+		invalidate();
+	}
+
+	if (valid && dirty.empty())
+		return;
+
+	size_t n = points.size();
+	builds++;
+
+	// just the dirty segments, or all of them
+	const std::vector<size_t>* which = 0;
+	if (valid && segments.size() == n) {
+		which = &dirty;
+		for (size_t k = 0; k < dirty.size(); k++)
+			stamps[dirty[k]] = builds;
+	}
+	else {
+		segments.resize(n);
+		stamps.assign(n, builds);
+	}
+
+	switch (type) {
+		case SPLINE_LINEAR:
+			foldSegments<LinearBasis>(points, tension, which, segments);
+			break;
+		case SPLINE_CARDINAL:
+			foldSegments<CardinalBasis>(points, tension, which, segments);
+			break;
+		case SPLINE_BSPLINE:
+			foldSegments<BSplineBasis>(points, tension, which, segments);
+			break;
+	}
+
+	dirty.clear();
+	valid = true;
+}
+
+//****************************************************************************
+//
+// * evaluate at a global parameter - floor(t) picks the segment
+//============================================================================
+void SplineCache::
+eval(float t, Pnt3f& pos, Pnt3f& dir, Pnt3f& up) const
+//============================================================================
+{
+	size_t n = segments.size();
+	if (!n)
+		return;
+
+	// wrap around the loop
+	t = fmodf(t, (float)n);
+	if (t < 0)
+		t += (float)n;
+
+	size_t i = (size_t)floorf(t);
+	if (i >= n)		// rounding right at the end of the loop
+		i = n - 1;
+	t -= (float)i;
+
+	evalLocal(i, t, pos, dir, up);
+}
+
+//****************************************************************************
+//
+// * evaluate inside one segment - Horner on the coefficients
+//============================================================================
+void SplineCache::
+evalLocal(size_t i, float t, Pnt3f& pos, Pnt3f& dir, Pnt3f& up) const
+//============================================================================
+{
+	const SplineSegment& s = segments[i];
+
+	pos = ((s.pos[0] * t + s.pos[1]) * t + s.pos[2]) * t + s.pos[3];
+
+	dir = (s.pos[0] * (3.0f * t) + s.pos[1] * 2.0f) * t + s.pos[2];
+	dir.normalize();
+
+	up = ((s.orient[0] * t + s.orient[1]) * t + s.orient[2]) * t + s.orient[3];
+	up.normalize();
+}
+
+//****************************************************************************
+//
+// * the straightforward way: r * G^T (M T) for one parameter. the cache
+//   doesn't use this, but it's handy to check against
+//============================================================================
+Pnt3f Matrix_Multiple(const float matrix[4][4], const float T_var[4], Pnt3f* g, float r)
+//============================================================================
+{
+	Pnt3f temp;
+	float result[4] = { 0 };
+
+	for (int i = 0; i < 4; i++)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			result[i] += (matrix[i][j] * T_var[j]);
+		}
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		temp = temp + (g[i] * result[i]);
+	}
+
+	return temp * r;
+}
+
+// the reference evaluator's matrices and control points, written out the
+// way TrainView::getPnt3f had them rather than taken from the bases above -
+// so a wrong entry in those can't also be in what they're checked against
+static const float referenceLinear[4][4] = {
+	0.0,  0.0, -1.0,  1.0,
+	0.0,  0.0,  1.0,  0.0,
+	0.0,  0.0,  0.0,  0.0,
+	0.0,  0.0,  0.0,  0.0
+};
+
+static const float referenceBSpline[4][4] = {		// times 1/6
+	-1.0,  3.0, -3.0,  1.0,
+	 3.0, -6.0,  0.0,  4.0,
+	-3.0,  3.0,  3.0,  1.0,
+	 1.0,  0.0,  0.0,  0.0
+};
+
+static const int linearIdx[4] = { 0, 1, 1, 1 };
+static const int cardinalPosIdx[4] = {-1, 0, 1, 2 };
+static const int cardinalOrientIdx[4] = { 0, 1, 2, 3 };
+static const int bsplineOrientIdx[4] = {-1, 1, 2, 3 };
+
+//****************************************************************************
+//
+// * evaluate straight from the control points, one basis matrix multiply
+//   per point - the way TrainView::getPnt3f used to do it. slow, but it is
+//   the reference the cached (and any faster) evaluators are checked against
+//============================================================================
+void evalReference(const std::vector<ControlPoint>& points, SplineType type,
+				   float t, Pnt3f& pos, Pnt3f& dir, Pnt3f& up, float tension)
+//============================================================================
+{
+	int n = (int)points.size();
+	if (!n)
+		return;
+
+	t = fmodf(t, (float)n);
+	if (t < 0)
+		t += (float)n;
+	int i = (int)floorf(t);
+	if (i >= n)
+		i = n - 1;
+	t -= (float)i;
+
+	// the cardinal matrix with tension s - at 0.5 it's getPnt3f's
+	// Catmull-Rom {-1,2,-1,0, 3,-5,0,2, -3,4,1,0, 1,-1,0,0} times 1/2
+	const float s = tension;
+	const float cardinalMatrix[4][4] = {
+		  -s,     2 * s,       -s,  0.0f,
+		2 - s,    s - 3,      0.0f, 1.0f,
+		s - 2,  3 - 2 * s,      s,  0.0f,
+		   s,      -s,        0.0f, 0.0f
+	};
+
+	const float (*matrix)[4] = cardinalMatrix;
+	float scale = 1.0f;
+	const int* posIdx = cardinalPosIdx;
+	const int* orientIdx = cardinalOrientIdx;
+	if (type == SPLINE_LINEAR) {
+		matrix = referenceLinear;
+		posIdx = orientIdx = linearIdx;
+	}
+	else if (type == SPLINE_BSPLINE) {
+		matrix = referenceBSpline;
+		scale = 1.0f / 6.0f;
+		orientIdx = bsplineOrientIdx;
+	}
+
+	const float T[4] = { t * t * t, t * t, t, 1.0f };
+	const float DT[4] = { 3.0f * t * t, 2.0f * t, 1.0f, 0.0f };
+
+	Pnt3f G[4];
+	for (int k = 0; k < 4; k++)
+		G[k] = points[(i + posIdx[k] + n) % n].pos;
+	pos = Matrix_Multiple(matrix, T, G, scale);
+	dir = Matrix_Multiple(matrix, DT, G, scale);
+	dir.normalize();
+
+	for (int k = 0; k < 4; k++)
+		G[k] = points[(i + orientIdx[k] + n) % n].orient;
+	up = Matrix_Multiple(matrix, T, G, scale);
+	up.normalize();
+}
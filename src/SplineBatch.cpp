@@ -0,0 +1,306 @@
+/************************************************************************
+     File:        SplineBatch.cpp
+
+     Comment:     Evaluating the spline at a lot of parameters at once
+
+						See SplineBatch.H. The evaluation itself is written
+						once (evalLanes), against a little set of operations
+						on "lanes" - a plain float, 4 floats in an SSE
+						register or 8 in an AVX one. Which one we get is
+						decided when this file is compiled.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+
+#if defined(__AVX__)
+	#include <immintrin.h>
+	#define SPLINE_BATCH_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define SPLINE_BATCH_SSE
+#endif
+
+#include "SplineBatch.H"
+
+// we pick the coefficients of a segment up as 24 floats in a row:
+// pos c0..c3 (x,y,z each), then orient c0..c3
+static_assert(sizeof(SplineSegment) == 24 * sizeof(float),
+			  "SplineSegment has to be 24 packed floats");
+
+// Pnt3f::normalize checks (double)len2 < .000001. There's no float
+// between the float closest to 1e-6 and 1e-6 itself, so in float that's
+// the same as len2 <= 1e-6f
+static const float tinyLength2 = 1e-6f;
+
+//****************************************************************************
+//
+// * one float at a time - the fallback, and the tail end of every batch
+//============================================================================
+struct ScalarLanes {
+//============================================================================
+	typedef float V;
+	typedef bool Mask;
+	enum { width = 1 };
+
+	static V set(float f)					{ return f; }
+	static V load(const float* p)			{ return *p; }
+	static void store(float* p, V v)		{ *p = v; }
+	static V add(V a, V b)					{ return a + b; }
+	static V mul(V a, V b)					{ return a * b; }
+	static V div(V a, V b)					{ return a / b; }
+	static V sqrt(V a)						{ return sqrtf(a); }
+	static Mask lessEqual(V a, V b)			{ return a <= b; }
+	static V select(Mask m, V a, V b)		{ return m ? a : b; }
+};
+
+#if defined(SPLINE_BATCH_AVX)
+
+//****************************************************************************
+//
+// * 8 at a time
+//============================================================================
+struct SimdLanes {
+//============================================================================
+	typedef __m256 V;
+	typedef __m256 Mask;
+	enum { width = 8 };
+
+	static V set(float f)					{ return _mm256_set1_ps(f); }
+	static V load(const float* p)			{ return _mm256_loadu_ps(p); }
+	static void store(float* p, V v)		{ _mm256_storeu_ps(p, v); }
+	static V add(V a, V b)					{ return _mm256_add_ps(a, b); }
+	static V mul(V a, V b)					{ return _mm256_mul_ps(a, b); }
+	static V div(V a, V b)					{ return _mm256_div_ps(a, b); }
+	static V sqrt(V a)						{ return _mm256_sqrt_ps(a); }
+	static Mask lessEqual(V a, V b)			{ return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	static V select(Mask m, V a, V b)		{ return _mm256_blendv_ps(b, a, m); }
+};
+
+#elif defined(SPLINE_BATCH_SSE)
+
+//****************************************************************************
+//
+// * 4 at a time
+//============================================================================
+struct SimdLanes {
+//============================================================================
+	typedef __m128 V;
+	typedef __m128 Mask;
+	enum { width = 4 };
+
+	static V set(float f)					{ return _mm_set1_ps(f); }
+	static V load(const float* p)			{ return _mm_loadu_ps(p); }
+	static void store(float* p, V v)		{ _mm_storeu_ps(p, v); }
+	static V add(V a, V b)					{ return _mm_add_ps(a, b); }
+	static V mul(V a, V b)					{ return _mm_mul_ps(a, b); }
+	static V div(V a, V b)					{ return _mm_div_ps(a, b); }
+	static V sqrt(V a)						{ return _mm_sqrt_ps(a); }
+	static Mask lessEqual(V a, V b)			{ return _mm_cmple_ps(a, b); }
+	static V select(Mask m, V a, V b)
+	{
+		return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+	}
+};
+
+#else
+
+typedef ScalarLanes SimdLanes;
+
+#endif
+
+//****************************************************************************
+//
+// * what Pnt3f::normalize does, in every lane (including making a
+//   vector that's too short to normalize point straight up)
+//============================================================================
+template <class L>
+static void normalize(typename L::V v[3])
+//============================================================================
+{
+	typedef typename L::V V;
+
+	V l = L::add(L::add(L::mul(v[0], v[0]), L::mul(v[1], v[1])), L::mul(v[2], v[2]));
+	typename L::Mask tiny = L::lessEqual(l, L::set(tinyLength2));
+	l = L::sqrt(l);
+
+	V zero = L::set(0.0f);
+	v[0] = L::select(tiny, zero, L::div(v[0], l));
+	v[1] = L::select(tiny, L::set(1.0f), L::div(v[1], l));
+	v[2] = L::select(tiny, zero, L::div(v[2], l));
+}
+
+//****************************************************************************
+//
+// * position, direction and up at local parameter u, for L::width
+//   segments at once (c holds the 24 coefficients, one lane per segment).
+//   same operations in the same order as SplineCache::eval
+//============================================================================
+template <class L>
+static void evalLanes(const typename L::V c[24], typename L::V u,
+					  SplineBatch& out, size_t at)
+//============================================================================
+{
+	typedef typename L::V V;
+
+	V u3 = L::mul(L::set(3.0f), u);
+	V two = L::set(2.0f);
+
+	V pos[3], dir[3], up[3];
+	for (int k = 0; k < 3; k++) {
+		const V* p = c + k;			// pos coefficients, component k
+		const V* o = c + 12 + k;	// orient coefficients, component k
+
+		pos[k] = L::add(L::mul(L::add(L::mul(L::add(L::mul(p[0], u), p[3]), u), p[6]), u), p[9]);
+		dir[k] = L::add(L::mul(L::add(L::mul(p[0], u3), L::mul(p[3], two)), u), p[6]);
+		up[k]  = L::add(L::mul(L::add(L::mul(L::add(L::mul(o[0], u), o[3]), u), o[6]), u), o[9]);
+	}
+
+	normalize<L>(dir);
+	normalize<L>(up);
+
+	for (int k = 0; k < 3; k++) {
+		L::store(&out.pos[k][at], pos[k]);
+		L::store(&out.dir[k][at], dir[k]);
+		L::store(&out.up[k][at], up[k]);
+	}
+}
+
+//****************************************************************************
+//
+// * split a global parameter into a segment and a local parameter, the
+//   same way SplineCache::eval does
+//============================================================================
+static size_t localParameter(float t, size_t n, float& u)
+//============================================================================
+{
+	t = fmodf(t, (float)n);
+	if (t < 0)
+		t += (float)n;
+
+	size_t i = (size_t)floorf(t);
+	if (i >= n)
+		i = n - 1;
+	u = t - (float)i;
+	return i;
+}
+
+//****************************************************************************
+//
+// * parameters one after the other: every lane can be in a different
+//   segment, so the coefficients get gathered lane by lane
+//============================================================================
+template <class L>
+static size_t evalParameters(const SplineCache& spline, const float* t, size_t first,
+							 size_t count, SplineBatch& out)
+//============================================================================
+{
+	typedef typename L::V V;
+	const size_t n = spline.size();
+	const size_t w = L::width;
+
+	size_t k = first;
+	for (; k + w <= count; k += w) {
+		float coef[24][w];
+		float u[w];
+		for (size_t l = 0; l < w; l++) {
+			size_t i = localParameter(t[k + l], n, u[l]);
+			const float* s = (const float*)&spline.segments[i];
+			for (int j = 0; j < 24; j++)
+				coef[j][l] = s[j];
+		}
+
+		V c[24];
+		for (int j = 0; j < 24; j++)
+			c[j] = L::load(coef[j]);
+		evalLanes<L>(c, L::load(u), out, k);
+	}
+	return k;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void SplineBatch::
+resize(size_t n)
+//============================================================================
+{
+	for (int k = 0; k < 3; k++) {
+		pos[k].resize(n);
+		dir[k].resize(n);
+		up[k].resize(n);
+	}
+}
+
+//****************************************************************************
+//
+// * a list of parameters - as many as we can in full registers, and the
+//   rest one at a time
+//============================================================================
+void evalBatch(const SplineCache& spline, const float* t, size_t count, SplineBatch& out)
+//============================================================================
+{
+	out.resize(count);
+	if (!spline.size())
+		return;
+
+	size_t done = evalParameters<SimdLanes>(spline, t, 0, count, out);
+	evalParameters<ScalarLanes>(spline, t, done, count, out);
+}
+
+//****************************************************************************
+//
+// * one segment, evenly spaced: the coefficients are the same in every
+//   lane, so they only get loaded once
+//============================================================================
+template <class L>
+static int evalSamples(const SplineSegment& s, int first, int samples,
+					   SplineBatch& out, size_t at)
+//============================================================================
+{
+	typedef typename L::V V;
+	const int w = L::width;
+
+	const float* coef = (const float*)&s;
+	V c[24];
+	for (int j = 0; j < 24; j++)
+		c[j] = L::set(coef[j]);
+
+	int k = first;
+	for (; k + w <= samples; k += w) {
+		float u[w];
+		for (int l = 0; l < w; l++)
+			u[l] = (float)(k + l) / (float)samples;
+		evalLanes<L>(c, L::load(u), out, at + k);
+	}
+	return k;
+}
+
+//****************************************************************************
+//
+// * samples across one segment
+//============================================================================
+void evalSegment(const SplineCache& spline, size_t segment, int samples,
+				 SplineBatch& out, size_t first)
+//============================================================================
+{
+	if (segment >= spline.size() || samples <= 0)
+		return;
+
+	const SplineSegment& s = spline.segments[segment];
+	int done = evalSamples<SimdLanes>(s, 0, samples, out, first);
+	evalSamples<ScalarLanes>(s, done, samples, out, first);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+int splineBatchWidth()
+//============================================================================
+{
+	return SimdLanes::width;
+}
@@ -0,0 +1,504 @@
+/************************************************************************
+     File:        Tessellate.cpp
+
+     Comment:     Sampling the track
+
+						See Tessellate.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "Tessellate.H"
+#include "WorkPool.H"
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrackSamples::
+clear()
+//============================================================================
+{
+	t.clear();
+	pos.clear();
+	u.clear();
+	v.clear();
+	w.clear();
+	segmentFirst.clear();
+	changed.clear();
+	shifted = true;
+}
+
+//****************************************************************************
+//
+// * Stepping a cubic  f(u) = c0 u^3 + c1 u^2 + c2 u + c3  by h at a time.
+//   Keep f and its first three differences; each step is then three adds
+//   (per component) instead of a whole polynomial
+//============================================================================
+struct ForwardCubic {
+//============================================================================
+	Pnt3f f, d1, d2, d3;
+
+	// exact values at u (this is also how we re-anchor)
+	void start(const Pnt3f c[4], float u, float h)
+	{
+		float h2 = h * h, h3 = h2 * h;
+		f  = ((c[0] * u + c[1]) * u + c[2]) * u + c[3];
+		d1 = c[0] * (3.0f * u * u * h + 3.0f * u * h2 + h3) + c[1] * (2.0f * u * h + h2) + c[2] * h;
+		d2 = c[0] * (6.0f * u * h2 + 6.0f * h3) + c[1] * (2.0f * h2);
+		d3 = c[0] * (6.0f * h3);
+	}
+
+	void step()
+	{
+		f = f + d1;
+		d1 = d1 + d2;
+		d2 = d2 + d3;
+	}
+};
+
+//****************************************************************************
+//
+// * the same for the derivative of the cubic (a quadratic)
+//   f'(u) = 3 c0 u^2 + 2 c1 u + c2
+//============================================================================
+struct ForwardQuadratic {
+//============================================================================
+	Pnt3f f, d1, d2;
+
+	void start(const Pnt3f c[4], float u, float h)
+	{
+		f  = (c[0] * (3.0f * u) + c[1] * 2.0f) * u + c[2];
+		d1 = c[0] * (3.0f * (2.0f * u * h + h * h)) + c[1] * (2.0f * h);
+		d2 = c[0] * (6.0f * h * h);
+	}
+
+	void step()
+	{
+		f = f + d1;
+		d1 = d1 + d2;
+	}
+};
+
+//****************************************************************************
+//
+// * one segment by forward differences, into out starting at sample first
+//============================================================================
+static void forwardSegment(const SplineSegment& s, int divide, TrackSamples& out, size_t first)
+//============================================================================
+{
+	float h = 1.0f / (float)divide;
+
+	ForwardCubic pos, up;
+	ForwardQuadratic dir;
+
+	for (int k = 0; k < divide; k++) {
+		if (k % forwardAnchorSteps == 0) {
+			float u = (float)k / (float)divide;
+			pos.start(s.pos, u, h);
+			dir.start(s.pos, u, h);
+			up.start(s.orient, u, h);
+		}
+
+		Pnt3f d = dir.f, v = up.f;
+		d.normalize();
+		v.normalize();
+
+		size_t i = first + k;
+		out.pos[i] = pos.f;
+		trackFrame(d, v, out.u[i], out.v[i], out.w[i]);
+
+		pos.step();
+		dir.step();
+		up.step();
+	}
+}
+
+//****************************************************************************
+//
+// * build the u/v/w frame from the direction and up vector
+//============================================================================
+void trackFrame(const Pnt3f& dir, const Pnt3f& up, Pnt3f& u, Pnt3f& v, Pnt3f& w)
+//============================================================================
+{
+	u = dir;
+	w = u * up;
+	w.normalize();
+	v = w * u;
+	v.normalize();
+}
+
+//****************************************************************************
+//
+// * evenly spaced samples in every segment, a segment at a time - either
+//   through the batch evaluator or by forward differences. every segment
+//   has its own place in the arrays, so they can be done in any order
+//============================================================================
+void tessellate(const SplineCache& spline, int divide, TrackSamples& out,
+				TessellateMethod method, WorkPool* pool)
+//============================================================================
+{
+	int pieces = (int)spline.size() * divide;
+	out.clear();
+	if (pieces <= 0)
+		return;
+
+	out.segmentFirst.resize(spline.size() + 1);
+	out.changed.resize(spline.size());
+	for (size_t i = 0; i <= spline.size(); i++)
+		out.segmentFirst[i] = i * divide;
+	for (size_t i = 0; i < spline.size(); i++)
+		out.changed[i] = i;
+
+	out.t.resize(pieces + 1);
+	out.pos.resize(pieces + 1);
+	out.u.resize(pieces + 1);
+	out.v.resize(pieces + 1);
+	out.w.resize(pieces + 1);
+
+	SplineBatch& batch = out.batch;
+	if (method != TESSELLATE_FORWARD)
+		batch.resize(pieces);
+
+	auto segments = [&](size_t first, size_t last) {
+		for (size_t i = first; i < last; i++) {
+			int from = (int)i * divide, to = from + divide;
+			if (method == TESSELLATE_FORWARD)
+				forwardSegment(spline.segments[i], divide, out, from);
+			else {
+				evalSegment(spline, i, divide, batch, from);
+				for (int k = from; k < to; k++) {
+					out.pos[k] = batch.position(k);
+					trackFrame(batch.direction(k), batch.upVector(k), out.u[k], out.v[k], out.w[k]);
+				}
+			}
+
+			for (int k = from; k < to; k++)
+				out.t[k] = (float)(k / divide) + (float)(k % divide) / (float)divide;
+		}
+	};
+	if (pool)
+		pool->run(spline.size(), tessellateChunk, segments);
+	else
+		segments(0, spline.size());
+
+	// and back to the start, to close the loop
+	out.pos[pieces] = out.pos[0];
+	out.u[pieces] = out.u[0];
+	out.v[pieces] = out.v[0];
+	out.w[pieces] = out.w[0];
+	out.t[pieces] = (float)spline.size();
+}
+
+//****************************************************************************
+//
+// * one end of a piece of the adaptive tessellation
+//============================================================================
+struct AdaptiveSample {
+//============================================================================
+	float u;		// in the segment
+	Pnt3f pos, dir, up;
+
+	void eval(const SplineCache& spline, size_t segment, float at)
+	{
+		u = at;
+		spline.evalLocal(segment, u, pos, dir, up);
+	}
+};
+
+//****************************************************************************
+//
+// * the angle between two unit vectors
+//============================================================================
+static float angleBetween(const Pnt3f& a, const Pnt3f& b)
+//============================================================================
+{
+	float c = a.x * b.x + a.y * b.y + a.z * b.z;
+	if (c > 1.0f) c = 1.0f;
+	if (c < -1.0f) c = -1.0f;
+	return acosf(c);
+}
+
+//****************************************************************************
+//
+// * how far p is from the line through a and b
+//============================================================================
+static float distanceToChord(const Pnt3f& p, const Pnt3f& a, const Pnt3f& b)
+//============================================================================
+{
+	Pnt3f ab = b - a, ap = p - a;
+	float len2 = ab.x * ab.x + ab.y * ab.y + ab.z * ab.z;
+	float s = len2 > 0 ? (ap.x * ab.x + ap.y * ab.y + ap.z * ab.z) / len2 : 0;
+	if (s < 0) s = 0;
+	if (s > 1) s = 1;
+	Pnt3f off = ap - ab * s;
+	return sqrtf(off.x * off.x + off.y * off.y + off.z * off.z);
+}
+
+//****************************************************************************
+//
+// * keep one sample
+//============================================================================
+static void addSample(TrackSamples& out, const AdaptiveSample& s, float t)
+//============================================================================
+{
+	Pnt3f u, v, w;
+	trackFrame(s.dir, s.up, u, v, w);
+	out.t.push_back(t);
+	out.pos.push_back(s.pos);
+	out.u.push_back(u);
+	out.v.push_back(v);
+	out.w.push_back(w);
+}
+
+//****************************************************************************
+//
+// * a piece of a segment waiting to be checked
+//============================================================================
+struct AdaptivePiece {
+//============================================================================
+	AdaptiveSample a, b;
+	int depth;
+};
+
+//****************************************************************************
+//
+// * split the pieces of segment i in half until they're close enough. the
+//   midpoint we test with becomes the new end, so every evaluation gets
+//   used. an explicit stack (left half on top) keeps the samples in order.
+//   each segment is done on its own, in its local parameter - the end of
+//   one is the start of the next, but with the curve coming in from this
+//   side rather than going out the other
+//============================================================================
+static void adaptiveSegment(const SplineCache& spline, size_t i,
+							const TessellateTolerance& tolerance,
+							std::vector<AdaptivePiece>& stack, TrackSamples& out)
+//============================================================================
+{
+	AdaptivePiece whole;
+	whole.a.eval(spline, i, 0);
+	whole.b.eval(spline, i, 1);
+	whole.depth = 0;
+
+	stack.push_back(whole);
+	while (!stack.empty()) {
+		AdaptivePiece p = stack.back();
+		stack.pop_back();
+
+		AdaptiveSample mid;
+		mid.eval(spline, i, 0.5f * (p.a.u + p.b.u));
+
+		bool split = p.depth < tolerance.maxDepth &&
+			(distanceToChord(mid.pos, p.a.pos, p.b.pos) > tolerance.chord ||
+			 angleBetween(p.a.dir, p.b.dir) > tolerance.angle ||
+			 angleBetween(p.a.up, p.b.up) > tolerance.angle ||
+			 // an S bend can point the same way at both ends
+			 angleBetween(p.a.dir, mid.dir) > tolerance.angle);
+
+		if (split) {
+			AdaptivePiece left = { p.a, mid, p.depth + 1 };
+			AdaptivePiece right = { mid, p.b, p.depth + 1 };
+			stack.push_back(right);
+			stack.push_back(left);
+		}
+		else
+			addSample(out, p.a, (float)i + p.a.u);
+	}
+}
+
+//****************************************************************************
+//
+// * the sample that closes the loop - the start again
+//============================================================================
+static void closeLoop(const SplineCache& spline, TrackSamples& out)
+//============================================================================
+{
+	AdaptiveSample first;
+	first.eval(spline, 0, 0);
+	addSample(out, first, (float)spline.size());
+}
+
+//****************************************************************************
+//
+// * copy count samples from one set to the end of another
+//============================================================================
+static void appendSamples(const TrackSamples& from, size_t first, size_t count,
+						  TrackSamples& to)
+//============================================================================
+{
+	to.t.insert(to.t.end(), from.t.begin() + first, from.t.begin() + first + count);
+	to.pos.insert(to.pos.end(), from.pos.begin() + first, from.pos.begin() + first + count);
+	to.u.insert(to.u.end(), from.u.begin() + first, from.u.begin() + first + count);
+	to.v.insert(to.v.end(), from.v.begin() + first, from.v.begin() + first + count);
+	to.w.insert(to.w.end(), from.w.begin() + first, from.w.begin() + first + count);
+}
+
+//****************************************************************************
+//
+// * copy count samples over the ones already there
+//============================================================================
+static void copySamples(const TrackSamples& from, size_t first, size_t count,
+						TrackSamples& to, size_t at)
+//============================================================================
+{
+	std::copy(from.t.begin() + first, from.t.begin() + first + count, to.t.begin() + at);
+	std::copy(from.pos.begin() + first, from.pos.begin() + first + count, to.pos.begin() + at);
+	std::copy(from.u.begin() + first, from.u.begin() + first + count, to.u.begin() + at);
+	std::copy(from.v.begin() + first, from.v.begin() + first + count, to.v.begin() + at);
+	std::copy(from.w.begin() + first, from.w.begin() + first + count, to.w.begin() + at);
+}
+
+//****************************************************************************
+//
+// * the whole track. with a pool, how many samples a chunk of segments
+//   gets isn't known until it's done - so each chunk is sampled into a
+//   part of its own, and then (once the parts' sizes say where they go)
+//   the parts are all copied into place at once
+//============================================================================
+void tessellateAdaptive(const SplineCache& spline, const TessellateTolerance& tolerance,
+						TrackSamples& out, WorkPool* pool)
+//============================================================================
+{
+	out.clear();
+
+	size_t n = spline.size();
+	if (!n)
+		return;
+
+	out.segmentFirst.resize(n + 1);
+	out.changed.resize(n);
+	for (size_t i = 0; i < n; i++)
+		out.changed[i] = i;
+
+	if (!pool) {
+		std::vector<AdaptivePiece> stack;
+		for (size_t i = 0; i < n; i++) {
+			out.segmentFirst[i] = out.pos.size();
+			adaptiveSegment(spline, i, tolerance, stack, out);
+		}
+		out.segmentFirst[n] = out.pos.size();
+	}
+	else {
+		// segment i goes in part i / tessellateChunk (and segmentFirst is
+		// where in the part, to start with)
+		size_t numParts = (n + tessellateChunk - 1) / tessellateChunk;
+		std::vector<TrackSamples> parts(numParts);
+		pool->run(n, tessellateChunk, [&](size_t first, size_t last) {
+			std::vector<AdaptivePiece> stack;
+			for (size_t i = first; i < last; i++) {
+				TrackSamples& part = parts[i / tessellateChunk];
+				out.segmentFirst[i] = part.pos.size();
+				adaptiveSegment(spline, i, tolerance, stack, part);
+			}
+		});
+
+		std::vector<size_t> partFirst(numParts + 1, 0);
+		for (size_t c = 0; c < numParts; c++)
+			partFirst[c + 1] = partFirst[c] + parts[c].pos.size();
+		for (size_t i = 0; i < n; i++)
+			out.segmentFirst[i] += partFirst[i / tessellateChunk];
+		out.segmentFirst[n] = partFirst[numParts];
+
+		size_t total = partFirst[numParts];
+		out.t.resize(total);
+		out.pos.resize(total);
+		out.u.resize(total);
+		out.v.resize(total);
+		out.w.resize(total);
+		pool->run(numParts, 1, [&](size_t first, size_t last) {
+			for (size_t c = first; c < last; c++)
+				copySamples(parts[c], 0, parts[c].pos.size(), out, partFirst[c]);
+		});
+	}
+	closeLoop(spline, out);
+	out.shifted = true;
+}
+
+//****************************************************************************
+//
+// * just the segments that changed. if they come out with the same number
+//   of samples as before (the usual thing when dragging a point a little)
+//   they go right over the old ones, otherwise the whole list gets put
+//   back together around them
+//============================================================================
+void retessellateAdaptive(const SplineCache& spline, const TessellateTolerance& tolerance,
+						  unsigned long since, TrackSamples& out)
+//============================================================================
+{
+	size_t n = spline.size();
+	if (!n || out.segmentFirst.size() != n + 1) {
+		tessellateAdaptive(spline, tolerance, out);
+		return;
+	}
+
+	out.changed.clear();
+	out.shifted = false;
+	for (size_t i = 0; i < n; i++)
+		if (spline.segmentVersion(i) > since)
+			out.changed.push_back(i);
+	if (out.changed.empty())
+		return;
+
+	// the new samples of the changed segments, one after the other
+	TrackSamples fresh;
+	std::vector<size_t> freshFirst;
+	std::vector<AdaptivePiece> stack;
+	bool sameCounts = true;
+	for (size_t c = 0; c < out.changed.size(); c++) {
+		size_t i = out.changed[c];
+		freshFirst.push_back(fresh.pos.size());
+		adaptiveSegment(spline, i, tolerance, stack, fresh);
+
+		size_t count = fresh.pos.size() - freshFirst[c];
+		if (count != out.segmentFirst[i + 1] - out.segmentFirst[i])
+			sameCounts = false;
+	}
+	freshFirst.push_back(fresh.pos.size());
+
+	if (sameCounts) {
+		for (size_t c = 0; c < out.changed.size(); c++)
+			copySamples(fresh, freshFirst[c], freshFirst[c + 1] - freshFirst[c],
+						out, out.segmentFirst[out.changed[c]]);
+	}
+	else {
+		TrackSamples joined;
+		std::vector<size_t> first(n + 1);
+		size_t c = 0;
+		for (size_t i = 0; i < n; i++) {
+			first[i] = joined.pos.size();
+			if (c < out.changed.size() && out.changed[c] == i) {
+				appendSamples(fresh, freshFirst[c], freshFirst[c + 1] - freshFirst[c], joined);
+				c++;
+			}
+			else
+				appendSamples(out, out.segmentFirst[i],
+							  out.segmentFirst[i + 1] - out.segmentFirst[i], joined);
+		}
+		first[n] = joined.pos.size();
+
+		out.t.swap(joined.t);
+		out.pos.swap(joined.pos);
+		out.u.swap(joined.u);
+		out.v.swap(joined.v);
+		out.w.swap(joined.w);
+		out.segmentFirst.swap(first);
+		out.shifted = true;
+
+		closeLoop(spline, out);
+		return;
+	}
+
+	// the closing sample is a copy of the first
+	if (out.changed[0] == 0) {
+		size_t last = out.segmentFirst[n];
+		out.pos[last] = out.pos[0];
+		out.u[last] = out.u[0];
+		out.v[last] = out.v[0];
+		out.w[last] = out.w[0];
+	}
+}
@@ -24,16 +24,23 @@
 
 *************************************************************************/
 
-#include "Track.H"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <charconv>
 
-#include <FL/fl_ask.h>
+#include "Track.H"
+#include "TrackFile.H"
+#include "WorkPool.H"
 
 //****************************************************************************
 //
 // * Constructor
 //============================================================================
 CTrack::
-CTrack() : trainU(0)
+CTrack() : tension(defaultTension)
 //============================================================================
 {
 	resetPoints();
@@ -54,48 +61,105 @@ resetPoints()
 	points.push_back(ControlPoint(Pnt3f(-50,5,0)));
 	points.push_back(ControlPoint(Pnt3f(0,5,-50)));
 
-	// we had better put the train back at the start of the track...
-	trainU = 0.0;
+	pointsChanged();
 }
 
 //****************************************************************************
 //
-// * Handy utility to break a string into a list of words
+// * Walks through the text of a track file. Words are separated by spaces,
+//   a # starts a comment that goes to the end of the line, and we keep
+//   count of the lines so errors can say where they are. It works right
+//   on the mapped file - nothing gets copied or allocated
 //============================================================================
-void breakString(char* str, std::vector<const char*>& words) 
+struct TextScanner {
 //============================================================================
-{
-	// start with no words
-	words.clear();
+	const char* p;
+	const char* end;
+	int line;
+
+	TextScanner(const char* text, size_t size) : p(text), end(text + size), line(1) {}
 
-	// scan through the string, starting at the beginning
-	char* p = str;
+	// skip spaces (but not the end of the line) and any comment
+	void skipSpace()
+	{
+		while (p < end && *p != '\n' && *p <= ' ') p++;
+		if (p < end && *p == '#')
+			while (p < end && *p != '\n') p++;
+	}
 
-	// stop when we hit the end of the string
-	while(*p) {
-		// skip over leading whitespace - stop at the first character or end of string
-		while (*p && *p<=' ') p++;
+	bool atEndOfLine()
+	{
+		skipSpace();
+		return p == end || *p == '\n';
+	}
 
-		// now we're pointing at the first thing after the spaces
-		// make sure its not a comment, and that we're not at the end of the string
-		// (that's actually the same thing)
-		if (! (*p) || *p == '#')
-		break;
+	bool atEnd() const { return p == end; }
 
-		// so we're pointing at a word! add it to the word list
-		words.push_back(p);
+	// only call this at the end of a line
+	void nextLine()
+	{
+		if (p < end) {
+			p++;
+			line++;
+		}
+	}
 
-		// now find the end of the word
-		while(*p > ' ') p++;	// stop at space or end of string
+	// the length of the word we're pointing at (for error messages)
+	int wordLength() const
+	{
+		const char* q = p;
+		while (q < end && *q > ' ' && *q != '#') q++;
+		return (int)(q - p);
+	}
 
-		// if its ethe end of the string, we're done
-		if (! *p) break;
+	// a whole word has to be a number - "1.5abc" is no good
+	template <typename T>
+	bool number(T& value)
+	{
+		skipSpace();
+		const char* start = p;
+		if (start < end && *start == '+')		// from_chars won't take a +
+			start++;
+		std::from_chars_result r = std::from_chars(start, end, value);
+		if (r.ec != std::errc() || (r.ptr < end && *r.ptr > ' ' && *r.ptr != '#'))
+			return false;
+		p = r.ptr;
+		return true;
+	}
 
-		// otherwise, turn this space into and end of string (to end the word)
-		// and keep going
-		*p = 0;
-		p++;
+	// the whole number at the start of the line, the way atoi reads it -
+	// "4.0" and "12 points" are 4 and 12. the rest of the line is skipped
+	bool leadingNumber(unsigned long& value)
+	{
+		skipSpace();
+		const char* start = p;
+		if (start < end && *start == '+')
+			start++;
+		std::from_chars_result r = std::from_chars(start, end, value);
+		if (r.ec != std::errc())
+			return false;
+		p = r.ptr;
+		while (p < end && *p != '\n') p++;
+		return true;
 	}
+};
+
+//****************************************************************************
+//
+// * an error message that says which line it's on
+//============================================================================
+static std::string lineError(int line, const char* format, ...)
+//============================================================================
+{
+	char msg[256];
+	int len = snprintf(msg, sizeof(msg), "line %d: ", line);
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(msg + len, sizeof(msg) - len, format, args);
+	va_end(args);
+
+	return msg;
 }
 
 //****************************************************************************
@@ -104,75 +168,365 @@ void breakString(char* str, std::vector<const char*>& words)
 //   first line: an integer with the number of control points
 //	  other lines: one line per control point
 //   either 3 (X,Y,Z) numbers on the line, or 6 numbers (X,Y,Z, orientation)
+//   blank lines and anything after a # are skipped
+// * unless it starts with the binary magic, then it's a binary track file
+// * returns false (and sets lastError) if the file can't be used - it's up
+//   to the caller to tell the user. the points are only replaced if the
+//   whole file is good
 //============================================================================
-void CTrack::
+bool CTrack::
 readPoints(const char* filename)
 //============================================================================
 {
-	FILE* fp = fopen(filename,"r");
-	if (!fp) {
-		fl_alert("Can't Open File!\n");
-	} 
-	else {
-		char buf[512];
-
-		// first line = number of points
-		fgets(buf,512,fp);
-		size_t npts = (size_t) atoi(buf);
-
-		if( (npts<4) || (npts>65535)) {
-			fl_alert("Illegal Number of Points Specified in File");
-		} else {
-			points.clear();
-			// get lines until EOF or we have enough points
-			while( (points.size() < npts) && fgets(buf,512,fp) ) {
-				Pnt3f pos,orient;
-				vector<const char*> words;
-				breakString(buf,words);
-				if (words.size() >= 3) {
-					pos.x = (float) strtod(words[0],0);
-					pos.y = (float) strtod(words[1],0);
-					pos.z = (float) strtod(words[2],0);
-				} else {
-					pos.x=0;
-					pos.y=0;
-					pos.z=0;
-				}
-				if (words.size() >= 6) {
-					orient.x = (float) strtod(words[3],0);
-					orient.y = (float) strtod(words[4],0);
-					orient.z = (float) strtod(words[5],0);
-				} else {
-					orient.x = 0;
-					orient.y = 1;
-					orient.z = 0;
-				}
-				orient.normalize();
-				points.push_back(ControlPoint(pos,orient));
+	MappedFile file;
+	if (!file.open(filename)) {
+		lastError = "Can't Open File!";
+		return false;
+	}
+
+	bool ok;
+	if (isTrackFile(file.data(), file.size()))
+		ok = readBinary(file.data(), file.size());
+	else
+		ok = readText((const char*)file.data(), file.size());
+
+	pointsChanged();
+	return ok;
+}
+
+//****************************************************************************
+//
+// * parse the text format (see readPoints) straight out of memory
+//============================================================================
+bool CTrack::
+readText(const char* text, size_t size)
+//============================================================================
+{
+	TextScanner scan(text, size);
+
+	// first line = number of points
+	while (!scan.atEnd() && scan.atEndOfLine())
+		scan.nextLine();
+
+	unsigned long npts = 0;
+	if (!scan.leadingNumber(npts)) {
+		lastError = lineError(scan.line, "Expected the Number of Points");
+		return false;
+	}
+	if ((npts < 4) || (npts > 65535)) {
+		lastError = lineError(scan.line, "Illegal Number of Points Specified in File");
+		return false;
+	}
+	scan.nextLine();
+
+	vector<ControlPoint> loaded;
+	loaded.reserve(npts);
+
+	while (loaded.size() < npts) {
+		if (scan.atEnd()) {
+			lastError = lineError(scan.line, "File Ends After %d of %d Points",
+								  (int)loaded.size(), (int)npts);
+			return false;
+		}
+		if (scan.atEndOfLine()) {
+			scan.nextLine();
+			continue;
+		}
+
+		float v[6];
+		int count = 0;
+		while (!scan.atEndOfLine()) {
+			if (count == 6) {
+				lastError = lineError(scan.line, "More Than 6 Numbers for a Point");
+				return false;
 			}
+			if (!scan.number(v[count])) {
+				lastError = lineError(scan.line, "\"%.*s\" is Not a Number",
+									  scan.wordLength(), scan.p);
+				return false;
+			}
+			count++;
 		}
-		fclose(fp);
+		if (count != 3 && count != 6) {
+			lastError = lineError(scan.line, "Expected 3 or 6 Numbers, Found %d", count);
+			return false;
+		}
+
+		Pnt3f pos(v[0], v[1], v[2]);
+		Pnt3f orient(0, 1, 0);
+		if (count == 6)
+			orient = Pnt3f(v[3], v[4], v[5]);
+		orient.normalize();
+		loaded.push_back(ControlPoint(pos, orient));
+
+		scan.nextLine();
 	}
-	trainU = 0;
+
+	points.swap(loaded);
+	return true;
 }
 
 //****************************************************************************
 //
 // * write the control points to our simple format
 //============================================================================
-void CTrack::
+bool CTrack::
 writePoints(const char* filename)
 //============================================================================
 {
+	size_t len = strlen(filename);
+	if (len >= 4 && !strcmp(filename + len - 4, ".trk"))
+		return writeBinary(filename);
+
 	FILE* fp = fopen(filename,"w");
 	if (!fp) {
-		fl_alert("Can't open file for writing");
+		lastError = "Can't open file for writing";
+		return false;
 	} else {
-		fprintf(fp,"%d\n",points.size());
+		fprintf(fp,"%d\n",(int)points.size());
 		for(size_t i=0; i<points.size(); ++i)
 			fprintf(fp,"%g %g %g %g %g %g\n",
 				points[i].pos.x, points[i].pos.y, points[i].pos.z, 
 				points[i].orient.x, points[i].orient.y, points[i].orient.z);
 		fclose(fp);
 	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * load a binary track file that's already in memory (see TrackFile.H).
+//   if it's no good, the points are left alone
+//============================================================================
+bool CTrack::
+readBinary(const unsigned char* data, size_t size)
+//============================================================================
+{
+	TrackFileHeader header;
+	if (size < sizeof(header)) {
+		lastError = "Track File is Truncated";
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	if (header.version != trackFileVersion) {
+		lastError = "Track File is From a Different Version";
+		return false;
+	}
+	if (header.headerSize < sizeof(header) || header.headerSize > size) {
+		lastError = "Track File Header is Damaged";
+		return false;
+	}
+
+	// make sure both arrays are really there before we trust count
+	size_t perPoint = 6 * sizeof(float);
+	if (header.count < 4) {
+		lastError = "Illegal Number of Points Specified in File";
+		return false;
+	}
+	if (header.count > (size - header.headerSize) / perPoint) {
+		lastError = "Track File is Truncated";
+		return false;
+	}
+
+	size_t n = (size_t)header.count;
+	const unsigned char* pos = data + header.headerSize;
+	const unsigned char* orient = pos + n * 3 * sizeof(float);
+
+	// one allocation for the lot. memcpy, since the arrays in the file
+	// needn't be aligned. the orientations get normalized, the same as
+	// readText does - the spline blends them before it normalizes, so
+	// otherwise a track could come out different from the two formats
+	points.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		memcpy(points[i].pos.v(), pos + i * 3 * sizeof(float), 3 * sizeof(float));
+		memcpy(points[i].orient.v(), orient + i * 3 * sizeof(float), 3 * sizeof(float));
+		points[i].orient.normalize();
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * write a binary track file: the header, all the positions, then all
+//   the orientations
+//============================================================================
+bool CTrack::
+writeBinary(const char* filename)
+//============================================================================
+{
+	FILE* fp = fopen(filename,"wb");
+	if (!fp) {
+		lastError = "Can't open file for writing";
+		return false;
+	}
+
+	TrackFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, trackFileMagic, sizeof(header.magic));
+	header.version = trackFileVersion;
+	header.headerSize = sizeof(header);
+	header.count = points.size();
+
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	for (size_t i = 0; ok && i < points.size(); ++i)
+		ok = fwrite(points[i].pos.v(), sizeof(float), 3, fp) == 3;
+	for (size_t i = 0; ok && i < points.size(); ++i)
+		ok = fwrite(points[i].orient.v(), sizeof(float), 3, fp) == 3;
+
+	if (fclose(fp) != 0)
+		ok = false;
+	if (!ok)
+		lastError = "Couldn't write the whole file";
+	return ok;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void CTrack::
+invalidateCaches()
+//============================================================================
+{
+	for (int i = 0; i < 3; i++)
+		splines[i].invalidate();
+	picks.invalidate();
+}
+
+//****************************************************************************
+//
+// * the control points have changed - forget the old coefficients, and
+//   take a whole new snapshot
+//============================================================================
+void CTrack::
+pointsChanged()
+//============================================================================
+{
+	invalidateCaches();
+	current = TrackSnapshot(points, tension, current.version() + 1);
+}
+
+//****************************************************************************
+//
+// * one control point changed - just the segments near it
+//============================================================================
+void CTrack::
+pointChanged(size_t i)
+//============================================================================
+{
+	for (int k = 0; k < 3; k++)
+		splines[k].invalidatePoint(i);
+	picks.invalidatePoint(i);
+	current = current.set(i, points[i]);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void CTrack::
+insertPoint(size_t i, const ControlPoint& p)
+//============================================================================
+{
+	points.insert(points.begin() + i, p);
+	invalidateCaches();
+	current = current.insert(i, p);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void CTrack::
+erasePoint(size_t i)
+//============================================================================
+{
+	points.erase(points.begin() + i);
+	invalidateCaches();
+	current = current.erase(i);
+}
+
+//****************************************************************************
+//
+// * the tension is just a number anyone can change, so it's only looked
+//   at here
+//============================================================================
+const TrackSnapshot& CTrack::
+snapshot()
+//============================================================================
+{
+	if (current.tension() != tension)
+		current = current.withTension(tension);
+	return current;
+}
+
+//****************************************************************************
+//
+// * get the coefficients for a spline type, building them if we need to
+//============================================================================
+const SplineCache& CTrack::
+spline(SplineType type)
+//============================================================================
+{
+	SplineCache& cache = splines[type - SPLINE_LINEAR];
+	cache.build(points, type, tension);
+	return cache;
+}
+
+//****************************************************************************
+//
+// * get the arc length table for a spline type - it only re-integrates
+//   the segments that changed since it was last used
+//============================================================================
+const ArcLengthTable& CTrack::
+arcLength(SplineType type)
+//============================================================================
+{
+	ArcLengthTable& table = arcLengths[type - SPLINE_LINEAR];
+	table.build(spline(type));
+	return table;
+}
+
+//****************************************************************************
+//
+// * get the frame table for a spline type - it's made from the arc length
+//   table, so that comes up to date first
+//============================================================================
+const FrameTable& CTrack::
+frames(SplineType type)
+//============================================================================
+{
+	FrameTable& table = frameTables[type - SPLINE_LINEAR];
+	const ArcLengthTable& arc = arcLength(type);
+	table.build(spline(type), arc, &WorkPool::shared());
+	return table;
+}
+
+//****************************************************************************
+//
+// * get the heights for a spline type - they're sampled by distance, so
+//   the arc length table comes up to date first
+//============================================================================
+const GradeTable& CTrack::
+grades(SplineType type)
+//============================================================================
+{
+	GradeTable& table = gradeTables[type - SPLINE_LINEAR];
+	const ArcLengthTable& arc = arcLength(type);
+	table.build(spline(type), arc);
+	return table;
+}
+
+//****************************************************************************
+//
+// * the pick index - built again if points came or went, otherwise just
+//   the boxes around the ones that moved are fixed
+//============================================================================
+const PickIndex& CTrack::
+pickIndex()
+//============================================================================
+{
+	picks.build(points);
+	return picks;
 }
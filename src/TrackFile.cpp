@@ -0,0 +1,184 @@
+/************************************************************************
+     File:        TrackFile.cpp
+
+     Comment:     The binary track file, and a read-only memory map to
+						load it with
+
+						See TrackFile.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "TrackFile.H"
+
+const char trackFileMagic[8] = { 'R', 'C', 'T', 'R', 'A', 'C', 'K', 0 };
+
+//****************************************************************************
+//
+// * check the magic
+//============================================================================
+bool isTrackFile(const void* data, size_t size)
+//============================================================================
+{
+	return size >= sizeof(trackFileMagic) &&
+		memcmp(data, trackFileMagic, sizeof(trackFileMagic)) == 0;
+}
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+MappedFile::
+MappedFile() : bytes(0), length(0)
+#ifdef _WIN32
+	, file(INVALID_HANDLE_VALUE), mapping(0)
+#endif
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * Destructor
+//============================================================================
+MappedFile::
+~MappedFile()
+//============================================================================
+{
+	close();
+}
+
+#ifdef _WIN32
+
+//****************************************************************************
+//
+// * map the file - a file mapping object, and a view of all of it
+//============================================================================
+bool MappedFile::
+open(const char* filename)
+//============================================================================
+{
+	close();
+
+	file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0,
+					   OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx((HANDLE)file, &fileSize)) {
+		close();
+		return false;
+	}
+	length = (size_t)fileSize.QuadPart;
+
+	// windows won't map an empty file
+	if (length == 0)
+		return true;
+
+	mapping = CreateFileMappingA((HANDLE)file, 0, PAGE_READONLY, 0, 0, 0);
+	if (!mapping) {
+		close();
+		return false;
+	}
+
+	bytes = (const unsigned char*)MapViewOfFile((HANDLE)mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!bytes) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+//****************************************************************************
+//
+// * unmap, and let go of the handles
+//============================================================================
+void MappedFile::
+close()
+//============================================================================
+{
+	if (bytes)
+		UnmapViewOfFile(bytes);
+	if (mapping)
+		CloseHandle((HANDLE)mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle((HANDLE)file);
+
+	bytes = 0;
+	length = 0;
+	mapping = 0;
+	file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+//****************************************************************************
+//
+// * map the file. the descriptor can be closed straight away - the
+//   mapping keeps the file alive
+//============================================================================
+bool MappedFile::
+open(const char* filename)
+//============================================================================
+{
+	close();
+
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		return false;
+	}
+	length = (size_t)st.st_size;
+
+	// mmap won't map an empty file
+	if (length == 0) {
+		::close(fd);
+		return true;
+	}
+
+	void* p = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED) {
+		length = 0;
+		return false;
+	}
+
+	// we read it front to back, once
+	madvise(p, length, MADV_SEQUENTIAL);
+
+	bytes = (const unsigned char*)p;
+	return true;
+}
+
+//****************************************************************************
+//
+// * unmap
+//============================================================================
+void MappedFile::
+close()
+//============================================================================
+{
+	if (bytes)
+		munmap((void*)bytes, length);
+	bytes = 0;
+	length = 0;
+}
+
+#endif
@@ -0,0 +1,521 @@
+/************************************************************************
+     File:        TrackMesh.cpp
+
+     Comment:     Retained geometry for drawing the track
+
+						See TrackMesh.H. The shapes are the same ones
+						TrainView::drawStuff used to draw by hand: a thick
+						line down the middle, a thin rail on each side and
+						a box for every tie.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <stddef.h>
+#include <math.h>
+
+#include <algorithm>
+
+// we will need OpenGL, and OpenGL needs windows.h (on Windows - these
+// also build elsewhere for Benchmark/RenderCheck.cpp)
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <glad/glad.h>
+
+#include "TrackMesh.H"
+#include "WorkPool.H"
+
+// half sizes of a tie (across the track, and along/up)
+static const float tieHalfLength = 3.0f;
+static const float tieHalfThick = 0.75f;
+
+// how far apart the ties are (along the rails) - it gets stretched a
+// little so a whole number of them goes around the loop
+static const float tieSpacing = 5.0f;
+
+// distance from the middle of the track to each side rail
+static const float railOffset = 2.5f;
+
+static const unsigned char railColor[4] = { 32, 32, 64, 255 };
+
+// a tie's box in its frame (x along the track, y up, z across), and the
+// colors of its faces (see BoxFace)
+static const float tieLo[3] = { -tieHalfThick, -tieHalfThick, -tieHalfLength };
+static const float tieHi[3] = { tieHalfThick, tieHalfThick, tieHalfLength };
+static const unsigned char tieColors[6][4] = {
+	{255,100,  0,255},		// bottom
+	{  0,200,255,255},		// top
+	{255,255,255,255},		// back
+	{255,255,255,255},		// front
+	{255,255,255,255},		// right
+	{255,255,255,255}		// left
+};
+
+//****************************************************************************
+//
+// * helper to make a vertex
+//============================================================================
+static TrackVertex makeVertex(const Pnt3f& p, const Pnt3f& n, const unsigned char c[4],
+							  float t = 0)
+//============================================================================
+{
+	TrackVertex tv;
+	tv.pos[0] = p.x;		tv.pos[1] = p.y;		tv.pos[2] = p.z;
+	tv.normal[0] = n.x;	tv.normal[1] = n.y;	tv.normal[2] = n.z;
+	tv.color[0] = c[0];	tv.color[1] = c[1];	tv.color[2] = c[2];	tv.color[3] = c[3];
+	tv.t = t;
+	return tv;
+}
+
+//****************************************************************************
+//
+// * helper to copy a point into a float array
+//============================================================================
+static void setFloats(float f[3], const Pnt3f& p)
+//============================================================================
+{
+	f[0] = p.x;
+	f[1] = p.y;
+	f[2] = p.z;
+}
+
+//****************************************************************************
+//
+// * how far apart two points are
+//============================================================================
+static float distance(const Pnt3f& a, const Pnt3f& b)
+//============================================================================
+{
+	Pnt3f d = b - a;
+	return sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+}
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+TrackMesh::
+TrackMesh()
+	: centerFirst(0), centerCount(0), railFirst(0), railCount(0),
+	  vao(0), vbo(0),
+	  tieBoxes(tieLo, tieHi, tieColors),
+	  builtCache(0), builtVersion(0)
+//============================================================================
+{
+	builtTolerance.chord = 0;
+	builtTolerance.angle = 0;
+	builtTolerance.maxDepth = -1;
+}
+
+//****************************************************************************
+//
+// * rebuild (and re-upload) only when what we built from has changed -
+//   and if it's the same spline with a few segments changed (a point is
+//   being dragged), only those segments
+//============================================================================
+void TrackMesh::
+update(const SplineCache& spline, const FrameTable& frames,
+	   const TessellateTolerance& tolerance)
+//============================================================================
+{
+	if (!vao)
+		return;
+
+	bool sameTolerance = builtTolerance.chord == tolerance.chord &&
+		builtTolerance.angle == tolerance.angle &&
+		builtTolerance.maxDepth == tolerance.maxDepth;
+	if (builtCache == &spline && builtVersion == spline.version() && sameTolerance)
+		return;
+
+	// sample the track, only as finely as the curves need - the last
+	// sample closes the loop. the whole track is done on all of the cores
+	if (builtCache == &spline && sameTolerance)
+		retessellateAdaptive(spline, tolerance, builtVersion, samples);
+	else
+		tessellateAdaptive(spline, tolerance, samples, &WorkPool::shared());
+	applyFrames(frames);
+
+	if (samples.shifted) {
+		generate();
+		upload();
+	}
+	else
+		refresh();
+
+	builtCache = &spline;
+	builtVersion = spline.version();
+	builtTolerance = tolerance;
+}
+
+//****************************************************************************
+//
+// * the tessellation's frames come straight from the spline's up vector,
+//   which twists where it lines up with the track - the rails and the
+//   ties use the rotation minimizing ones from the frame table instead
+//============================================================================
+void TrackMesh::
+applyFrames(const FrameTable& frames)
+//============================================================================
+{
+	size_t n = samples.segmentFirst.empty() ? 0 : samples.segmentFirst.size() - 1;
+	if (!n)
+		return;
+
+	// every segment's samples are its own, so a lot of them can be done
+	// on all of the cores
+	bool all = samples.shifted;
+	size_t count = all ? n : samples.changed.size();
+	auto segments = [&](size_t first, size_t last) {
+		for (size_t c = first; c < last; c++) {
+			size_t i = all ? c : samples.changed[c];
+			for (size_t k = samples.segmentFirst[i]; k < samples.segmentFirst[i + 1]; k++)
+				frames.frameAt(i, samples.t[k] - (float)i, samples.u[k], samples.v[k], samples.w[k]);
+		}
+	};
+	WorkPool::shared().run(count, tessellateChunk, segments);
+
+	// the sample that closes the loop is the start of segment 0 again
+	if (all || (!samples.changed.empty() && samples.changed[0] == 0)) {
+		size_t last = samples.segmentFirst[n];
+		frames.frameAt((size_t)0, 0.0f, samples.u[last], samples.v[last], samples.w[last]);
+	}
+}
+
+//****************************************************************************
+//
+// * the rail vertices of piece k (samples k to k+1): the middle line
+//   first, then the side rails - offset sideways by the frame at the
+//   start of the piece
+//============================================================================
+void TrackMesh::
+setPiece(int k)
+//============================================================================
+{
+	const std::vector<Pnt3f>& pos = samples.pos;
+	TrackVertex* center = &vertices[centerFirst + 2 * k];
+	TrackVertex* rails = &vertices[railFirst + 4 * k];
+
+	float t0 = samples.t[k], t1 = samples.t[k + 1];
+
+	center[0] = makeVertex(pos[k], samples.v[k], railColor, t0);
+	center[1] = makeVertex(pos[k + 1], samples.v[k + 1], railColor, t1);
+
+	Pnt3f side = samples.w[k] * railOffset;
+	rails[0] = makeVertex(pos[k] + side, samples.v[k], railColor, t0);
+	rails[1] = makeVertex(pos[k + 1] + side, samples.v[k + 1], railColor, t1);
+	rails[2] = makeVertex(pos[k] - side, samples.v[k], railColor, t0);
+	rails[3] = makeVertex(pos[k + 1] - side, samples.v[k + 1], railColor, t1);
+}
+
+//****************************************************************************
+//
+// * the ties of segment i. the samples are closer together in the curves,
+//   so the ties can't just go on them - they're spaced evenly along the
+//   rails instead, with the frame blended between the two ends of the
+//   piece they land in. each segment gets its own whole number of them,
+//   so changing one segment doesn't move the ties of the others
+//============================================================================
+void TrackMesh::
+segmentTies(size_t i, std::vector<BoxInstance>& into)
+//============================================================================
+{
+	const std::vector<Pnt3f>& pos = samples.pos;
+	size_t first = samples.segmentFirst[i];
+	size_t last = samples.segmentFirst[i + 1];
+
+	float total = 0;
+	for (size_t k = first; k < last; k++)
+		total += distance(pos[k], pos[k + 1]);
+
+	int count = (int)(total / tieSpacing + 0.5f);
+	if (count < 1)
+		return;
+	float spacing = total / (float)count;
+
+	float along = 0;
+	size_t k = first;
+	float len = distance(pos[k], pos[k + 1]);
+	for (int j = 0; j < count; j++) {
+		float at = spacing * ((float)j + 0.5f);
+		while (k + 1 < last && along + len < at) {
+			along += len;
+			k++;
+			len = distance(pos[k], pos[k + 1]);
+		}
+		float f = len > 0 ? (at - along) / len : 0;
+
+		Pnt3f dir = samples.u[k] * (1 - f) + samples.u[k + 1] * f;
+		Pnt3f up = samples.v[k] * (1 - f) + samples.v[k + 1] * f;
+		dir.normalize();
+
+		// in the frame u (along), v (up), w (across)
+		Pnt3f u, v, w;
+		trackFrame(dir, up, u, v, w);
+
+		BoxInstance tie;
+		setFloats(tie.pos, pos[k] * (1 - f) + pos[k + 1] * f);
+		setFloats(tie.u, u);
+		setFloats(tie.v, v);
+		setFloats(tie.w, w);
+		tie.t = samples.t[k] * (1 - f) + samples.t[k + 1] * f;
+		into.push_back(tie);
+	}
+}
+
+//****************************************************************************
+//
+// * build all of the rails and the ties from the samples
+//============================================================================
+void TrackMesh::
+generate()
+//============================================================================
+{
+	int pieces = (int)samples.pieces();
+
+	vertices.resize(6 * pieces);
+	centerFirst = 0;
+	centerCount = 2 * pieces;
+	railFirst = centerCount;
+	railCount = 4 * pieces;
+	for (int k = 0; k < pieces; k++)
+		setPiece(k);
+
+	size_t n = samples.segmentFirst.empty() ? 0 : samples.segmentFirst.size() - 1;
+	ties.clear();
+	tieFirst.resize(n + 1);
+	for (size_t i = 0; i < n; i++) {
+		tieFirst[i] = ties.size();
+		segmentTies(i, ties);
+	}
+	tieFirst[n] = ties.size();
+}
+
+//****************************************************************************
+//
+// * only some segments have new samples (and the same number of them as
+//   before) - redo their pieces and ties and send just those parts of the
+//   buffers. the piece just before a segment ends on its first sample, so
+//   it gets redone too
+//============================================================================
+void TrackMesh::
+refresh()
+//============================================================================
+{
+	int pieces = (int)samples.pieces();
+	const std::vector<size_t>& changed = samples.changed;
+	const std::vector<size_t>& first = samples.segmentFirst;
+
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	for (size_t c = 0; c < changed.size(); c++) {
+		size_t i = changed[c];
+		int from = (int)first[i] - 1;
+		int to = (int)first[i + 1];
+
+		// before the first segment is the last piece of the loop
+		if (from < 0) {
+			setPiece(pieces - 1);
+			uploadPieces(pieces - 1, pieces);
+			from = 0;
+		}
+		for (int k = from; k < to; k++)
+			setPiece(k);
+		uploadPieces(from, to);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// the ties - if a segment wants a different number, they all move
+	std::vector<BoxInstance> fresh;
+	bool sameCounts = true;
+	std::vector<size_t> freshFirst;
+	for (size_t c = 0; c < changed.size(); c++) {
+		size_t i = changed[c];
+		freshFirst.push_back(fresh.size());
+		segmentTies(i, fresh);
+		if (fresh.size() - freshFirst[c] != tieFirst[i + 1] - tieFirst[i])
+			sameCounts = false;
+	}
+	freshFirst.push_back(fresh.size());
+
+	if (sameCounts) {
+		for (size_t c = 0; c < changed.size(); c++) {
+			size_t count = freshFirst[c + 1] - freshFirst[c];
+			if (!count)
+				continue;
+			std::copy(fresh.begin() + freshFirst[c], fresh.begin() + freshFirst[c + 1],
+					  ties.begin() + tieFirst[changed[c]]);
+			tieBoxes.uploadRange(tieFirst[changed[c]], count, &ties[tieFirst[changed[c]]]);
+		}
+	}
+	else {
+		size_t n = first.size() - 1;
+		ties.clear();
+		for (size_t i = 0; i < n; i++) {
+			tieFirst[i] = ties.size();
+			segmentTies(i, ties);
+		}
+		tieFirst[n] = ties.size();
+		tieBoxes.upload(ties);
+	}
+}
+
+//****************************************************************************
+//
+// * make the buffers, the vertex arrays and the tie shader. the vertex
+//   arrays remember the array setup, so drawing is just bind and go
+//============================================================================
+void TrackMesh::
+createGL()
+//============================================================================
+{
+	// the rails - fixed function arrays
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(TrackVertex),
+		(const void*)offsetof(TrackVertex, pos));
+	glNormalPointer(GL_FLOAT, sizeof(TrackVertex),
+		(const void*)offsetof(TrackVertex, normal));
+	glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(TrackVertex),
+		(const void*)offsetof(TrackVertex, color));
+
+	// the parameter, for the ID buffer's shader
+	glEnableVertexAttribArray(7);
+	glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(TrackVertex),
+		(const void*)offsetof(TrackVertex, t));
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	tieBoxes.createGL();
+
+	// the new buffers are empty - make the next update fill them
+	builtCache = 0;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrackMesh::
+releaseGL()
+//============================================================================
+{
+	if (vao) {
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &vbo);
+	}
+	tieBoxes.releaseGL();
+	abandonGL();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrackMesh::
+abandonGL()
+//============================================================================
+{
+	vao = vbo = 0;
+	tieBoxes.abandonGL();
+	builtCache = 0;
+}
+
+//****************************************************************************
+//
+// * put the rail vertices and the tie frames in their buffers
+//============================================================================
+void TrackMesh::
+upload()
+//============================================================================
+{
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(TrackVertex),
+		vertices.empty() ? 0 : &vertices[0], GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	tieBoxes.upload(ties);
+}
+
+//****************************************************************************
+//
+// * send the rail vertices of pieces [from,to) - they're in two places,
+//   the middle line and the side rails. the vertex buffer is bound
+//============================================================================
+void TrackMesh::
+uploadPieces(int from, int to)
+//============================================================================
+{
+	if (to <= from)
+		return;
+	glBufferSubData(GL_ARRAY_BUFFER, (centerFirst + 2 * from) * sizeof(TrackVertex),
+		2 * (to - from) * sizeof(TrackVertex), &vertices[centerFirst + 2 * from]);
+	glBufferSubData(GL_ARRAY_BUFFER, (railFirst + 4 * from) * sizeof(TrackVertex),
+		4 * (to - from) * sizeof(TrackVertex), &vertices[railFirst + 4 * from]);
+}
+
+//****************************************************************************
+//
+// * draw the track from the buffers. the rails go through whatever
+//   program is current (the shadow map's, in the main pass)
+//============================================================================
+void TrackMesh::
+draw(bool doingShadows, const ShadowMap* shadows)
+//============================================================================
+{
+	if (!vao)
+		return;
+
+	glBindVertexArray(vao);
+
+	// no colors for the depth pass
+	if (doingShadows)
+		glDisableClientState(GL_COLOR_ARRAY);
+
+	glLineWidth(3);
+	glDrawArrays(GL_LINES, centerFirst, centerCount);
+	glLineWidth(1);
+	glDrawArrays(GL_LINES, railFirst, railCount);
+
+	if (doingShadows)
+		glEnableClientState(GL_COLOR_ARRAY);
+
+	glBindVertexArray(0);
+
+	// all of the ties in one go
+	tieBoxes.draw(shadows);
+}
+
+//****************************************************************************
+//
+// * the same geometry into the ID buffer. the lines are drawn wider, so
+//   the track is easier to hit
+//============================================================================
+void TrackMesh::
+drawIds(const IdBuffer& ids)
+//============================================================================
+{
+	if (!vao)
+		return;
+
+	ids.setObject(PICK_TRACK, 0, 0, true);
+	glBindVertexArray(vao);
+	glLineWidth(7);
+	glDrawArrays(GL_LINES, centerFirst, centerCount);
+	glLineWidth(5);
+	glDrawArrays(GL_LINES, railFirst, railCount);
+	glLineWidth(1);
+
+	glBindVertexArray(0);
+
+	tieBoxes.drawIds(ids, PICK_TIE);
+}
@@ -0,0 +1,380 @@
+/************************************************************************
+     File:        TrackSnapshot.cpp
+
+     Comment:     The control points as a version that never changes
+
+						See TrackSnapshot.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <algorithm>
+
+#include "TrackSnapshot.H"
+#include "Spline.H"
+
+typedef std::shared_ptr<const TrackNode> NodePtr;
+
+//****************************************************************************
+//
+// * a leaf has points, any other node has children - never both. a node
+//   is only ever changed while it's being made, before any version has it
+//============================================================================
+struct TrackNode {
+//============================================================================
+	size_t count;							// points under this node
+	std::vector<ControlPoint> points;
+	std::vector<NodePtr> children;
+
+	TrackNode() : count(0) {}
+
+	bool leaf() const { return children.empty(); }
+};
+
+//****************************************************************************
+//
+// * which child point i is under - and i becomes where it is in that
+//   child. i can be one past the end (for adding to the end), which is
+//   then in the last child
+//============================================================================
+static size_t findChild(const TrackNode& node, size_t& i)
+//============================================================================
+{
+	size_t c = 0;
+	while (c + 1 < node.children.size() && i >= node.children[c]->count) {
+		i -= node.children[c]->count;
+		c++;
+	}
+	return c;
+}
+
+//****************************************************************************
+//
+// * a node that's got one too many - the second half goes in a new one
+//============================================================================
+static NodePtr splitNode(TrackNode& node)
+//============================================================================
+{
+	std::shared_ptr<TrackNode> right = std::make_shared<TrackNode>();
+	if (node.leaf()) {
+		size_t half = node.points.size() / 2;
+		right->points.assign(node.points.begin() + half, node.points.end());
+		node.points.resize(half);
+		right->count = right->points.size();
+	}
+	else {
+		size_t half = node.children.size() / 2;
+		right->children.assign(node.children.begin() + half, node.children.end());
+		node.children.resize(half);
+		for (size_t c = 0; c < right->children.size(); c++)
+			right->count += right->children[c]->count;
+	}
+	node.count -= right->count;
+	return right;
+}
+
+//****************************************************************************
+//
+// * the copy of node with point i replaced
+//============================================================================
+static NodePtr setAt(const TrackNode& node, size_t i, const ControlPoint& p)
+//============================================================================
+{
+	std::shared_ptr<TrackNode> copy = std::make_shared<TrackNode>(node);
+	if (node.leaf())
+		copy->points[i] = p;
+	else {
+		size_t c = findChild(node, i);
+		copy->children[c] = setAt(*node.children[c], i, p);
+	}
+	return copy;
+}
+
+//****************************************************************************
+//
+// * the copy of node with p put in before point i. if that's too many
+//   for one node, split is the second half (and the copy is the first)
+//============================================================================
+static NodePtr insertAt(const TrackNode& node, size_t i, const ControlPoint& p, NodePtr& split)
+//============================================================================
+{
+	std::shared_ptr<TrackNode> copy = std::make_shared<TrackNode>(node);
+	copy->count++;
+	split.reset();
+
+	if (node.leaf())
+		copy->points.insert(copy->points.begin() + i, p);
+	else {
+		size_t c = findChild(node, i);
+		NodePtr right;
+		copy->children[c] = insertAt(*node.children[c], i, p, right);
+		if (right)
+			copy->children.insert(copy->children.begin() + c + 1, right);
+	}
+
+	if (copy->points.size() > snapshotChunk || copy->children.size() > snapshotChunk)
+		split = splitNode(*copy);
+	return copy;
+}
+
+//****************************************************************************
+//
+// * the copy of node without point i - or nothing, if that was the last
+//   one under it. nodes are never joined back together, so lots of
+//   erasing leaves them part empty, but the tree never gets deeper than
+//   it was
+//============================================================================
+static NodePtr eraseAt(const TrackNode& node, size_t i)
+//============================================================================
+{
+	std::shared_ptr<TrackNode> copy = std::make_shared<TrackNode>(node);
+	copy->count--;
+
+	if (node.leaf()) {
+		copy->points.erase(copy->points.begin() + i);
+		return copy->points.empty() ? NodePtr() : copy;
+	}
+
+	size_t c = findChild(node, i);
+	NodePtr child = eraseAt(*node.children[c], i);
+	if (child)
+		copy->children[c] = child;
+	else
+		copy->children.erase(copy->children.begin() + c);
+	return copy->children.empty() ? NodePtr() : copy;
+}
+
+//****************************************************************************
+//
+// * the points of a node, added to the end of out
+//============================================================================
+static void appendPoints(const TrackNode& node, std::vector<ControlPoint>& out)
+//============================================================================
+{
+	if (node.leaf())
+		out.insert(out.end(), node.points.begin(), node.points.end());
+	else
+		for (size_t c = 0; c < node.children.size(); c++)
+			appendPoints(*node.children[c], out);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+static bool samePoint(const ControlPoint& a, const ControlPoint& b)
+//============================================================================
+{
+	return a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.pos.z == b.pos.z &&
+		a.orient.x == b.orient.x && a.orient.y == b.orient.y && a.orient.z == b.orient.z;
+}
+
+//****************************************************************************
+//
+// * the points that differ between two nodes with the same number of
+//   points, starting at first. a node they share can't have changed, and
+//   nodes split up the same way can be compared child by child - past
+//   that (points came and went) every point is checked
+//============================================================================
+static void diffNodes(const NodePtr& a, const NodePtr& b, size_t first,
+					  std::vector<size_t>& changed)
+//============================================================================
+{
+	if (a == b)
+		return;
+
+	bool sameShape = a->leaf() == b->leaf() && a->children.size() == b->children.size();
+	for (size_t c = 0; sameShape && c < a->children.size(); c++)
+		sameShape = a->children[c]->count == b->children[c]->count;
+
+	if (sameShape && !a->leaf()) {
+		for (size_t c = 0; c < a->children.size(); c++) {
+			diffNodes(a->children[c], b->children[c], first, changed);
+			first += a->children[c]->count;
+		}
+		return;
+	}
+
+	std::vector<ControlPoint> pa, pb;
+	pa.reserve(a->count);
+	pb.reserve(b->count);
+	appendPoints(*a, pa);
+	appendPoints(*b, pb);
+	for (size_t i = 0; i < pa.size(); i++)
+		if (!samePoint(pa[i], pb[i]))
+			changed.push_back(first + i);
+}
+
+//****************************************************************************
+//
+// * Constructors
+//============================================================================
+TrackSnapshot::
+TrackSnapshot()
+	: tensionValue(defaultTension), versionValue(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * the leaves first, then a level of nodes over them, and so on up to
+//   the one at the top
+//============================================================================
+TrackSnapshot::
+TrackSnapshot(const std::vector<ControlPoint>& points, float tension, unsigned long version)
+	: tensionValue(tension), versionValue(version)
+//============================================================================
+{
+	std::vector<NodePtr> level;
+	for (size_t first = 0; first < points.size(); first += snapshotChunk) {
+		std::shared_ptr<TrackNode> leaf = std::make_shared<TrackNode>();
+		size_t last = std::min(first + snapshotChunk, points.size());
+		leaf->points.assign(points.begin() + first, points.begin() + last);
+		leaf->count = last - first;
+		level.push_back(leaf);
+	}
+
+	while (level.size() > 1) {
+		std::vector<NodePtr> up;
+		for (size_t first = 0; first < level.size(); first += snapshotChunk) {
+			std::shared_ptr<TrackNode> node = std::make_shared<TrackNode>();
+			size_t last = std::min(first + snapshotChunk, level.size());
+			node->children.assign(level.begin() + first, level.begin() + last);
+			for (size_t c = 0; c < node->children.size(); c++)
+				node->count += node->children[c]->count;
+			up.push_back(node);
+		}
+		level.swap(up);
+	}
+
+	if (!level.empty())
+		root = level[0];
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+TrackSnapshot::
+TrackSnapshot(const NodePtr& root, float tension, unsigned long version)
+	: root(root), tensionValue(tension), versionValue(version)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+size_t TrackSnapshot::
+size() const
+//============================================================================
+{
+	return root ? root->count : 0;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+const ControlPoint& TrackSnapshot::
+operator[](size_t i) const
+//============================================================================
+{
+	const TrackNode* node = root.get();
+	while (!node->leaf())
+		node = node->children[findChild(*node, i)].get();
+	return node->points[i];
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrackSnapshot::
+copyTo(std::vector<ControlPoint>& out) const
+//============================================================================
+{
+	out.clear();
+	out.reserve(size());
+	if (root)
+		appendPoints(*root, out);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+TrackSnapshot TrackSnapshot::
+set(size_t i, const ControlPoint& p) const
+//============================================================================
+{
+	return TrackSnapshot(setAt(*root, i, p), tensionValue, versionValue + 1);
+}
+
+//****************************************************************************
+//
+// * if the top node splits, a new one goes over the two halves - that's
+//   the only way the tree gets deeper
+//============================================================================
+TrackSnapshot TrackSnapshot::
+insert(size_t i, const ControlPoint& p) const
+//============================================================================
+{
+	if (!root)
+		return TrackSnapshot(std::vector<ControlPoint>(1, p), tensionValue, versionValue + 1);
+
+	NodePtr split;
+	NodePtr top = insertAt(*root, i, p, split);
+	if (split) {
+		std::shared_ptr<TrackNode> both = std::make_shared<TrackNode>();
+		both->children.push_back(top);
+		both->children.push_back(split);
+		both->count = top->count + split->count;
+		top = both;
+	}
+	return TrackSnapshot(top, tensionValue, versionValue + 1);
+}
+
+//****************************************************************************
+//
+// * a top node with just one child isn't needed any more
+//============================================================================
+TrackSnapshot TrackSnapshot::
+erase(size_t i) const
+//============================================================================
+{
+	NodePtr top = eraseAt(*root, i);
+	while (top && !top->leaf() && top->children.size() == 1)
+		top = top->children[0];
+	return TrackSnapshot(top, tensionValue, versionValue + 1);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+TrackSnapshot TrackSnapshot::
+withTension(float tension) const
+//============================================================================
+{
+	return TrackSnapshot(root, tension, versionValue + 1);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool TrackSnapshot::
+changedSince(const TrackSnapshot& older, std::vector<size_t>& changed) const
+//============================================================================
+{
+	changed.clear();
+	if (size() != older.size())
+		return false;
+	if (root)
+		diffNodes(older.root, root, 0, changed);
+	return true;
+}
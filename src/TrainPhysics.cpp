@@ -0,0 +1,148 @@
+/************************************************************************
+     File:        TrainPhysics.cpp
+
+     Comment:     Letting gravity run the trains
+
+						See TrainPhysics.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "TrainPhysics.H"
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+GradeTable::
+GradeTable()
+	: spacing(gradeSpacing), inverseSpacing(1.0f / gradeSpacing), total(0), builtFrom(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * the pieces are stretched a little so a whole number of them goes
+//   around, and the last height is the first (it's a loop)
+//============================================================================
+void GradeTable::
+build(const SplineCache& spline, const ArcLengthTable& arc)
+//============================================================================
+{
+	if (!heights.empty() && builtFrom == spline.version())
+		return;
+	builtFrom = spline.version();
+
+	total = arc.length();
+	size_t n = (size_t)ceilf(total / gradeSpacing);
+	n = std::min(std::max(n, (size_t)1), gradeMaxSamples);
+	spacing = total > 0 ? total / (float)n : gradeSpacing;
+	inverseSpacing = 1.0f / spacing;
+
+	heights.resize(n + 1);
+	for (size_t j = 0; j < n; j++) {
+		Pnt3f pos, dir, up;
+		spline.eval(arc.toParameter(spacing * (float)j), pos, dir, up);
+		heights[j] = pos.y;
+	}
+	heights[n] = heights[0];
+
+	slope.resize(n);
+	for (size_t j = 0; j < n; j++)
+		slope[j] = (heights[j + 1] - heights[j]) * inverseSpacing;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+size_t GradeTable::
+cell(float s) const
+//============================================================================
+{
+	if (s <= 0)
+		return 0;
+	return std::min((size_t)(s * inverseSpacing), slope.size() - 1);
+}
+
+//****************************************************************************
+//
+// * along the ramp the distance is on
+//============================================================================
+float GradeTable::
+height(float s) const
+//============================================================================
+{
+	size_t j = cell(s);
+	return heights[j] + slope[j] * (s - spacing * (float)j);
+}
+
+//****************************************************************************
+//
+// * Constructor
+//============================================================================
+TrainPhysics::
+TrainPhysics()
+	: gravity(9.8f), rollingFriction(0.01f), drag(0.0005f), liftSpeed(0)
+//============================================================================
+{
+}
+
+//****************************************************************************
+//
+// * friction and drag only ever slow a train down - friction stops it
+//   rather than turning it around, and drag is done implicitly so it
+//   can't overshoot either
+//============================================================================
+void TrainPhysics::
+step(TrainSet& trains, const GradeTable& grades, float dt) const
+//============================================================================
+{
+	if (grades.length() <= 0)
+		return;
+	trains.fit(grades.length());
+
+	const float rolling = rollingFriction * gravity * dt;
+	for (size_t k = 0; k < trains.numTrains(); k++) {
+		size_t first = trains.firstCar[k], last = trains.firstCar[k + 1];
+
+		// gravity along the track, averaged over the cars
+		float sum = 0;
+		for (size_t i = first; i < last; i++)
+			sum += grades.grade(trains.s[i]);
+		float v = trains.velocity[first] - gravity * dt * sum / (float)(last - first);
+
+		v = (v > rolling) ? v - rolling : ((v < -rolling) ? v + rolling : 0.0f);
+		v /= 1.0f + drag * fabsf(v) * dt;
+		// the lift hill chain only pulls where the train is climbing - down
+		// the other side and along the flat it's on its own
+		if (liftSpeed > 0 && sum > 0)
+			v = std::max(v, liftSpeed);
+
+		trains.setVelocity(k, v);
+	}
+
+	trains.advance(dt, grades.length());
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+float TrainPhysics::
+energy(const TrainSet& trains, const GradeTable& grades, size_t k) const
+//============================================================================
+{
+	size_t first = trains.firstCar[k], last = trains.firstCar[k + 1];
+	float h = 0;
+	for (size_t i = first; i < last; i++)
+		h += grades.height(trains.s[i]);
+	float v = trains.velocity[first];
+	return 0.5f * v * v + gravity * h / (float)(last - first);
+}
@@ -0,0 +1,166 @@
+/************************************************************************
+     File:        TrainSet.cpp
+
+     Comment:     Where all of the trains are
+
+						See TrainSet.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "TrainSet.H"
+
+//****************************************************************************
+//
+// * distance d wrapped onto a track length long
+//============================================================================
+static float wrap(float d, float length)
+//============================================================================
+{
+	d = fmodf(d, length);
+	return d < 0 ? d + length : d;
+}
+
+//****************************************************************************
+//
+// * Constructor - one train of one car, like there always was
+//============================================================================
+TrainSet::
+TrainSet()
+	: length(0)
+//============================================================================
+{
+	make(1, 1, 0);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrainSet::
+make(int numTrains, int carsEach, float trackLength)
+//============================================================================
+{
+	numTrains = std::max(numTrains, 1);
+	carsEach = std::max(carsEach, 1);
+	size_t n = (size_t)numTrains * (size_t)carsEach;
+
+	s.assign(n, 0.0f);
+	velocity.assign(n, 0.0f);
+	offset.resize(n);
+	firstCar.resize(numTrains + 1);
+	for (int k = 0; k <= numTrains; k++)
+		firstCar[k] = (size_t)k * carsEach;
+	for (size_t i = 0; i < n; i++)
+		offset[i] = (float)(i % carsEach) * carSpacing;
+
+	restart(trackLength);
+}
+
+//****************************************************************************
+//
+// * the first cars evenly around the track, and the rest behind them
+//============================================================================
+void TrainSet::
+restart(float trackLength)
+//============================================================================
+{
+	length = trackLength;
+	std::fill(velocity.begin(), velocity.end(), 0.0f);
+	for (size_t k = 0; k < numTrains(); k++)
+		s[firstCar[k]] = trackLength * (float)k / (float)numTrains();
+	couple();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+size_t TrainSet::
+trainOf(size_t i) const
+//============================================================================
+{
+	return std::upper_bound(firstCar.begin(), firstCar.end(), i) - firstCar.begin() - 1;
+}
+
+//****************************************************************************
+//
+// * the cars of a train are next to each other
+//============================================================================
+void TrainSet::
+setVelocity(size_t k, float v)
+//============================================================================
+{
+	std::fill(velocity.begin() + firstCar[k], velocity.begin() + firstCar[k + 1], v);
+}
+
+//****************************************************************************
+//
+// * the loop is the same thing done to every car, with the wrap done by
+//   selects rather than branches, so it vectorizes. a car can't go more
+//   than once around in one step
+//============================================================================
+void TrainSet::
+advance(float dt, float trackLength)
+//============================================================================
+{
+	if (trackLength <= 0)
+		return;
+	fit(trackLength);
+
+	const size_t n = s.size();
+	float* pos = &s[0];
+	const float* vel = &velocity[0];
+	const float L = trackLength;
+	for (size_t i = 0; i < n; i++) {
+		float x = pos[i] + vel[i] * dt;
+		x = (x >= L) ? x - L : x;
+		x = (x < 0) ? x + L : x;
+		pos[i] = x;
+	}
+}
+
+//****************************************************************************
+//
+// * a track we haven't seen the length of yet gets the trains where
+//   restart() puts them
+//============================================================================
+void TrainSet::
+fit(float trackLength)
+//============================================================================
+{
+	if (trackLength <= 0 || trackLength == length)
+		return;
+
+	if (length > 0) {
+		float scale = trackLength / length;
+		length = trackLength;
+		for (size_t k = 0; k < numTrains(); k++)
+			s[firstCar[k]] = wrap(s[firstCar[k]] * scale, trackLength);
+		couple();
+	}
+	else
+		restart(trackLength);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrainSet::
+couple()
+//============================================================================
+{
+	if (length <= 0)
+		return;
+	for (size_t k = 0; k < numTrains(); k++) {
+		float lead = s[firstCar[k]];
+		for (size_t i = firstCar[k] + 1; i < firstCar[k + 1]; i++)
+			s[i] = wrap(lead - offset[i], length);
+	}
+}
@@ -0,0 +1,421 @@
+/************************************************************************
+     File:        TrainSimulation.cpp
+
+     Comment:     Running the trains on a thread of their own
+
+						See TrainSimulation.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "TrainSimulation.H"
+
+typedef std::chrono::steady_clock SimulationClock;
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void placeCars(const TrainSet& trains, const SplineCache& spline, const ArcLengthTable& arc,
+			   const FrameTable& frames, std::vector<BoxInstance>& out)
+//============================================================================
+{
+	out.resize(trains.numCars());
+	for (size_t i = 0; i < out.size(); i++) {
+		float t = arc.toParameter(trains.s[i]);
+		Pnt3f pos, dir, up, u, v, w;
+		spline.eval(t, pos, dir, up);
+		frames.frameAt(t, u, v, w);
+
+		BoxInstance& car = out[i];
+		car.pos[0] = pos.x;	car.pos[1] = pos.y;	car.pos[2] = pos.z;
+		car.u[0] = u.x;		car.u[1] = u.y;		car.u[2] = u.z;
+		car.v[0] = v.x;		car.v[1] = v.y;		car.v[2] = v.z;
+		car.w[0] = w.x;		car.w[1] = w.y;		car.w[2] = w.z;
+		car.t = t;
+	}
+}
+
+//****************************************************************************
+//
+// * Constructor - the settings are the widgets' defaults until the window
+//   says otherwise
+//============================================================================
+TrainSimulation::
+TrainSimulation()
+	: published(0), publishedData(0), running(false), type(SPLINE_CARDINAL), time(0),
+	  behind(0)
+//============================================================================
+{
+	SimulationSettings defaults = { 2.0f, true, false, true, 1.0f, 60.0f };
+	settings = defaults;
+
+	requests.quit = requests.changed = requests.running = false;
+	requests.settings = defaults;
+	requests.type = SPLINE_CARDINAL;
+	requests.make = requests.restart = false;
+	requests.numTrains = requests.carsEach = 1;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+TrainSimulation::
+~TrainSimulation()
+//============================================================================
+{
+	stop();
+}
+
+//****************************************************************************
+//
+// * there's a snapshot before the worker even starts, so the window
+//   always has something to draw
+//============================================================================
+void TrainSimulation::
+start(void (*callback)(void*), void* data)
+//============================================================================
+{
+	if (worker.joinable())
+		return;
+	published = callback;
+	publishedData = data;
+	publish();
+	worker = std::thread(&TrainSimulation::run, this);
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrainSimulation::
+stop()
+//============================================================================
+{
+	if (!worker.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> held(lock);
+		requests.quit = requests.changed = true;
+	}
+	wake.notify_one();
+	worker.join();
+	requests.quit = false;
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrainSimulation::
+setSettings(const SimulationSettings& newSettings)
+//============================================================================
+{
+	{
+		std::lock_guard<std::mutex> held(lock);
+		requests.settings = newSettings;
+		requests.changed = true;
+	}
+	wake.notify_one();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrainSimulation::
+setTrack(const TrackSnapshot& newTrack, SplineType newType)
+//============================================================================
+{
+	{
+		std::lock_guard<std::mutex> held(lock);
+		requests.track = newTrack;
+		requests.type = newType;
+		requests.changed = true;
+	}
+	wake.notify_one();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrainSimulation::
+setRunning(bool run)
+//============================================================================
+{
+	{
+		std::lock_guard<std::mutex> held(lock);
+		requests.running = run;
+		requests.changed = true;
+	}
+	wake.notify_one();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrainSimulation::
+makeTrains(int numTrains, int carsEach)
+//============================================================================
+{
+	{
+		std::lock_guard<std::mutex> held(lock);
+		requests.make = true;
+		requests.restart = false;
+		requests.numTrains = numTrains;
+		requests.carsEach = carsEach;
+		requests.changed = true;
+	}
+	wake.notify_one();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrainSimulation::
+restart()
+//============================================================================
+{
+	{
+		std::lock_guard<std::mutex> held(lock);
+		requests.restart = true;
+		requests.changed = true;
+	}
+	wake.notify_one();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+void TrainSimulation::
+step(float dir, float dt)
+//============================================================================
+{
+	{
+		std::lock_guard<std::mutex> held(lock);
+		requests.steps.push_back(std::make_pair(dir, dt));
+		requests.changed = true;
+	}
+	wake.notify_one();
+}
+
+//****************************************************************************
+//
+// * sleep until it's time for the next frame (or forever, if we're not
+//   running) or the window wants something, catch the trains up to the
+//   clock a fixed step at a time, and publish where they are
+//============================================================================
+void TrainSimulation::
+run()
+//============================================================================
+{
+	SimulationClock::time_point lastTick = SimulationClock::now();
+	SimulationClock::time_point nextFrame = lastTick;
+	Requests taken;
+
+	for (;;) {
+		bool wasRunning = running;
+		{
+			std::unique_lock<std::mutex> held(lock);
+			if (running)
+				wake.wait_until(held, nextFrame, [this] { return requests.changed; });
+			else
+				wake.wait(held, [this] { return requests.changed; });
+			if (requests.quit)
+				return;
+
+			// take it all, and let the window carry on
+			taken.changed = requests.changed;
+			taken.running = requests.running;
+			taken.settings = requests.settings;
+			taken.track = requests.track;
+			taken.type = requests.type;
+			taken.make = requests.make;
+			taken.numTrains = requests.numTrains;
+			taken.carsEach = requests.carsEach;
+			taken.restart = requests.restart;
+			taken.steps.swap(requests.steps);
+			requests.changed = requests.make = requests.restart = false;
+			requests.steps.clear();
+		}
+		bool moved = apply(taken);
+
+		SimulationClock::time_point now = SimulationClock::now();
+		if (running) {
+			if (!wasRunning) {
+				lastTick = nextFrame = now;
+				behind = 0;
+			}
+			double scale = settings.timeScale;
+			behind += std::chrono::duration<double>(now - lastTick).count() * scale;
+			lastTick = now;
+
+			// if we got stuck, don't try to make it all up at once
+			behind = std::min(behind, 0.25 * scale);
+			while (behind >= simulationStep) {
+				advance(1, simulationStep);
+				behind -= simulationStep;
+			}
+			moved = true;
+
+			// the next frame is a frame after this one was due - unless
+			// we're that far behind already
+			std::chrono::duration<double> period(1.0 / std::max(settings.frameRate, 1.0f));
+			nextFrame += std::chrono::duration_cast<SimulationClock::duration>(period);
+			if (nextFrame < now)
+				nextFrame = now + std::chrono::duration_cast<SimulationClock::duration>(period);
+		}
+
+		if (moved)
+			publish();
+	}
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+bool TrainSimulation::
+apply(Requests& taken)
+//============================================================================
+{
+	if (!taken.changed)
+		return false;
+
+	settings = taken.settings;
+	running = taken.running;
+
+	if (taken.track.size() &&
+		(taken.track.version() != track.version() || taken.type != type))
+		useTrack(taken.track, taken.type);
+	if (settings.physics && !points.empty())
+		grades.build(spline, arc);
+
+	float length = arc.length();
+	if (taken.make)
+		trains.make(taken.numTrains, taken.carsEach, length);
+	else if (taken.restart)
+		trains.restart(length);
+
+	for (size_t i = 0; i < taken.steps.size(); i++)
+		advance(taken.steps[i].first, taken.steps[i].second);
+	taken.steps.clear();
+	return true;
+}
+
+//****************************************************************************
+//
+// * the same type of spline on the same number of points only needs the
+//   points that moved - anything else is built from scratch
+//============================================================================
+void TrainSimulation::
+useTrack(const TrackSnapshot& newTrack, SplineType newType)
+//============================================================================
+{
+	std::vector<size_t> changed;
+	if (newType == type && points.size() && newTrack.changedSince(track, changed)) {
+		for (size_t c = 0; c < changed.size(); c++) {
+			points[changed[c]] = newTrack[changed[c]];
+			spline.invalidatePoint(changed[c]);
+		}
+	}
+	else {
+		newTrack.copyTo(points);
+		spline.invalidate();
+	}
+	track = newTrack;
+	type = newType;
+
+	spline.build(points, type, track.tension());
+	arc.build(spline);
+	frames.build(spline, arc);
+	trains.fit(arc.length());
+}
+
+//****************************************************************************
+//
+// * The speeds are how far the train used to go each time the old loop
+//   ran (30 times a second)
+//============================================================================
+void TrainSimulation::
+advance(float dir, float dt)
+//============================================================================
+{
+	if (points.empty())
+		return;
+	time += dt;
+
+	// left to gravity - the physics only runs forward in time, so << steps
+	// it forward too. the speed is how fast the lift hill chain goes
+	if (settings.physics && grades.length() > 0) {
+		physics.liftSpeed = settings.lift ? settings.speed * 10.0f : 0.0f;
+		// the steps are counted first - taking them off a float one at a
+		// time can leave a last step of a few nanoseconds. a total that's
+		// a whole number of steps (give or take the rounding) gets just
+		// those, and anything else ends on a shorter step for the rest
+		float total = fabsf(dir) * dt;
+		int steps = (int)ceilf(total / simulationStep - 1e-3f);
+		for (int i = 1; i < steps; i++)
+			physics.step(trains, grades, simulationStep);
+		if (steps > 0)
+			physics.step(trains, grades, total - (float)(steps - 1) * simulationStep);
+		return;
+	}
+
+	float length = arc.length();
+	trains.fit(length);
+
+	// the speeds are per old 30Hz step, so these are per second
+	for (size_t k = 0; k < trains.numTrains(); k++) {
+		float v;
+		if (settings.arcLength)
+			// a fixed distance along the track (in world units)
+			v = dir * (settings.speed * 3.0f * 30.0f);
+		else {
+			// a fixed amount of parameter - as a distance, that's this
+			// much of the segment the first car is in
+			float t = arc.toParameter(trains.s[trains.leadCar(k)]);
+			size_t i = std::min((size_t)t, spline.size() - 1);
+			v = dir * (settings.speed * .05f * 30.0f) * arc.segmentLength(i);
+		}
+		trains.setVelocity(k, v);
+	}
+
+	// then all of the cars at once
+	trains.advance(dt, length);
+}
+
+//****************************************************************************
+//
+// * the copies keep their memory, so this only allocates when there are
+//   more cars than ever before
+//============================================================================
+void TrainSimulation::
+publish()
+//============================================================================
+{
+	TrainSnapshot& out = snapshots.writing();
+	out.s.assign(trains.s.begin(), trains.s.end());
+	out.firstCar.assign(trains.firstCar.begin(), trains.firstCar.end());
+	if (points.empty())
+		out.cars.clear();
+	else
+		placeCars(trains, spline, arc, frames, out.cars);
+	out.length = trains.length;
+	out.time = time;
+	snapshots.publish();
+
+	if (published)
+		published(publishedData);
+}
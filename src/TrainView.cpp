@@ -25,6 +25,8 @@
 *************************************************************************/
 
 #include <iostream>
+#include <algorithm>
+#include <math.h>
 #include <Fl/fl.h>
 
 // we will need OpenGL, and OpenGL needs windows.h
@@ -44,20 +46,158 @@
 #endif
 
 
+// a car in its frame (along the track, up, across) - it rides a little
+// above the rails - and its colors (see BoxFace): green in front, blue
+// behind
+static const float carLo[3] = { -carLength / 2, 0.75f, -carWidth / 2 };
+static const float carHi[3] = { carLength / 2, 0.75f + carHeight, carWidth / 2 };
+static const unsigned char carColors[6][4] = {
+	{255,255,255,255},		// bottom
+	{  0,  0,  0,255},		// top
+	{  0,  0,255,255},		// back
+	{  0,255,  0,255},		// front
+	{255,  0,  0,255},		// right
+	{255,  0,  0,255}		// left
+};
+
+//************************************************************************
+//
+// * Draw a control point (a cube with a point on top, pointing in the
+//   direction of its orientation) - assumes the color is correct
+//========================================================================
+static void drawControlPoint(const ControlPoint& cp)
+//========================================================================
+{
+	const Pnt3f& pos = cp.pos;
+	const Pnt3f& orient = cp.orient;
+	float size=2.0;
+
+	glPushMatrix();
+	glTranslatef(pos.x,pos.y,pos.z);
+	float theta1 = -radiansToDegrees(atan2(orient.z,orient.x));
+	glRotatef(theta1,0,1,0);
+	float theta2 = -radiansToDegrees(acos(orient.y));
+	glRotatef(theta2,0,0,1);
+
+		glBegin(GL_QUADS);
+			glNormal3f( 0,0,1);
+			glVertex3f( size, size, size);
+			glVertex3f(-size, size, size);
+			glVertex3f(-size,-size, size);
+			glVertex3f( size,-size, size);
+
+			glNormal3f( 0, 0, -1);
+			glVertex3f( size, size, -size);
+			glVertex3f( size,-size, -size);
+			glVertex3f(-size,-size, -size);
+			glVertex3f(-size, size, -size);
+
+			// no top - it will be the point
+
+			glNormal3f( 0,-1,0);
+			glVertex3f( size,-size, size);
+			glVertex3f(-size,-size, size);
+			glVertex3f(-size,-size,-size);
+			glVertex3f( size,-size,-size);
+
+			glNormal3f( 1,0,0);
+			glVertex3f( size, size, size);
+			glVertex3f( size,-size, size);
+			glVertex3f( size,-size,-size);
+			glVertex3f( size, size,-size);
+
+			glNormal3f(-1,0,0);
+			glVertex3f(-size, size, size);
+			glVertex3f(-size, size,-size);
+			glVertex3f(-size,-size,-size);
+			glVertex3f(-size,-size, size);
+		glEnd();
+		glBegin(GL_TRIANGLE_FAN);
+			glNormal3f(0,1.0f,0);
+			glVertex3f(0,3.0f*size,0);
+			glNormal3f( 1.0f, 0.0f , 1.0f);
+			glVertex3f( size, size , size);
+			glNormal3f(-1.0f, 0.0f , 1.0f);
+			glVertex3f(-size, size , size);
+			glNormal3f(-1.0f, 0.0f ,-1.0f);
+			glVertex3f(-size, size ,-size);
+			glNormal3f( 1.0f, 0.0f ,-1.0f);
+			glVertex3f( size, size ,-size);
+			glNormal3f( 1.0f, 0.0f , 1.0f);
+			glVertex3f( size, size , size);
+		glEnd();
+	glPopMatrix();
+}
+
+// how often to look for the answer to an ID buffer pick
+static const double pickPollSeconds = 1.0 / 120.0;
+
+//************************************************************************
+//
+// * see if the ID buffer pick has come back yet - if not, look again a
+//   little later
+//========================================================================
+static void pickPollCB(void* v)
+//========================================================================
+{
+	TrainView* tv = (TrainView*)v;
+	tv->make_current();
+
+	PickResult pick;
+	if (tv->idBuffer.poll(pick))
+		tv->picked(pick);
+	else if (tv->idBuffer.pending())
+		Fl::repeat_timeout(pickPollSeconds, pickPollCB, v);
+}
+
 //************************************************************************
 //
 // * Constructor to set up the GL window
 //========================================================================
 TrainView::
 TrainView(int x, int y, int w, int h, const char* l)
-	: Fl_Gl_Window(x, y, w, h, l)
+	: Fl_Gl_Window(x, y, w, h, l),
+	  cars(carLo, carHi, carColors), firstCarDrawn(0), snapshot(0)
 	//========================================================================
 {
-	mode(FL_RGB | FL_ALPHA | FL_DOUBLE | FL_STENCIL);
+	mode(FL_RGB | FL_ALPHA | FL_DOUBLE);
+
+	// everything that keeps GL objects around
+	glContext.add(&trackMesh);
+	glContext.add(&shadowMap);
+	glContext.add(&ground);
+	glContext.add(&idBuffer);
+	glContext.add(&cars);
+	pickQueued = false;
+	pickX = pickY = 0;
 
 	resetArcball();
 }
 
+//************************************************************************
+//
+// * Destructor - the GL objects have to go before the context does
+//========================================================================
+TrainView::
+~TrainView()
+//========================================================================
+{
+	glContext.release(this);
+}
+
+//************************************************************************
+//
+// * Hiding the window throws away the context, so let go of the GL
+//   objects while we can
+//========================================================================
+void TrainView::
+hide()
+//========================================================================
+{
+	glContext.release(this);
+	Fl_Gl_Window::hide();
+}
+
 //************************************************************************
 //
 // * Reset the camera to look at the world
@@ -97,6 +237,12 @@ int TrainView::handle(int event)
 		// Mouse button being pushed event
 	case FL_PUSH:
 		last_push = Fl::event_button();
+		// shift-click picks anything (and puts a point on the track)
+		if (last_push == FL_LEFT_MOUSE && (Fl::event_state() & FL_SHIFT)) {
+			queuePick(Fl::event_x(), Fl::event_y());
+			last_push = 0;
+			return 1;
+		}
 		// if the left button be pushed is left mouse button
 		if (last_push == FL_LEFT_MOUSE) {
 			doPick();
@@ -132,6 +278,7 @@ int TrainView::handle(int event)
 			cp->pos.x = (float)rx;
 			cp->pos.y = (float)ry;
 			cp->pos.z = (float)rz;
+			m_pTrack->pointChanged(selectedCube);
 			damage(1);
 		}
 		break;
@@ -183,13 +330,35 @@ void TrainView::draw()
 	// * Set up basic opengl informaiton
 	//
 	//**********************************************************************
-	//initialized glad
-	if (gladLoadGL())
-	{
-		//initiailize VAO, VBO, Shader...
+	// GL only needs to be loaded (and our buffers made) once per context
+	glContext.begin(this);
+
+	// rebuild the track geometry only if the spline changed
+	trackMesh.update(m_pTrack->spline(splineType()), m_pTrack->frames(splineType()),
+					 trackTolerance);
+
+	// the cars move every frame - wherever the simulation last put them
+	// (the same snapshot for the whole frame)
+	tw->syncSimulation();
+	snapshot = &tw->simulation.latest();
+	updateCars();
+
+	//*********************************************************************
+	//
+	// * the shadow map: everything but the floor, from the sun
+	//   (lightPosition1 below). it only has to hold what casts shadows -
+	//   every control point, with some room for the train and the track -
+	//   not the whole floor, however big that is
+	//
+	//**********************************************************************
+	float radius = 50.0f;
+	for (size_t i = 0; i < m_pTrack->points.size(); i++) {
+		const Pnt3f& p = m_pTrack->points[i].pos;
+		radius = std::max(radius, sqrtf(p.x * p.x + p.y * p.y + p.z * p.z) + 20.0f);
 	}
-	else
-		throw std::runtime_error("Could not initialize GLAD!");
+	shadowMap.beginDepth(Pnt3f(0, 1, 1), Pnt3f(0, 0, 0), radius);
+	drawStuff(true);
+	shadowMap.endDepth();
 
 	// Set up the view port
 	glViewport(0, 0, w(), h());
@@ -197,10 +366,7 @@ void TrainView::draw()
 	// clear the window, be sure to clear the Z-Buffer too
 	glClearColor(0, 0, .3f, 0);		// background should be blue
 
-	// we need to clear out the stencil buffer since we'll use
-	// it for shadows
-	glClearStencil(0);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glEnable(GL_DEPTH);
 
 	// Blayne prefers GL_DIFFUSE
@@ -258,30 +424,24 @@ void TrainView::draw()
 
 
 	//*********************************************************************
-	// now draw the ground plane
+	// now draw the ground plane, and then the objects - through the
+	// shadow map's shader (the opengl 1.x draw functions still work)
 	//*********************************************************************
-	// set to opengl fixed pipeline(use opengl 1.x draw function)
 	glUseProgram(0);
 
-	setupFloor();
-	glDisable(GL_LIGHTING);
-	drawFloor(200, 10);
-
-
-	//*********************************************************************
-	// now draw the object and we need to do it twice
-	// once for real, and then once for shadows
-	//*********************************************************************
-	glEnable(GL_LIGHTING);
-	setupObjects();
-
+	shadowMap.beginLit(tw->topCam->value() ? 1 : 3);
+	ground.draw(&shadowMap);
 	drawStuff();
-
-	// this time drawing is for shadows (except for top view)
-	if (!tw->topCam->value()) {
-		setupShadows();
-		drawStuff(true);
-		unsetupShadows();
+	shadowMap.endLit();
+
+	// a pick was asked for - draw the IDs for it, with the same view
+	if (pickQueued) {
+		pickQueued = false;
+		if (idBuffer.begin(pickX, pickY, w(), h())) {
+			drawStuff(true, &idBuffer);
+			idBuffer.end();
+			Fl::add_timeout(pickPollSeconds, pickPollCB, this);
+		}
 	}
 }
 
@@ -330,9 +490,17 @@ setProjection()
 	else
 	{
 		//arcball.setup(this, 40, 250, .2f, .4f, 0);
-		Pnt3f pos, dir, up;
-
-		this->getPnt3f(this->t_time, pos, dir, up);
+		Pnt3f pos, dir, up, across;
+
+		// ride in the first car of the first train
+		if (snapshot && !snapshot->cars.empty()) {
+			const BoxInstance& car = snapshot->cars[0];
+			pos = Pnt3f(car.pos[0], car.pos[1], car.pos[2]);
+			dir = Pnt3f(car.u[0], car.u[1], car.u[2]);
+			up = Pnt3f(car.v[0], car.v[1], car.v[2]);
+		}
+		else
+			this->trainFrame(0, pos, dir, up, across);
 
 		glMatrixMode(GL_PROJECTION);
 		glLoadIdentity();
@@ -341,7 +509,7 @@ setProjection()
 
 		glMatrixMode(GL_MODELVIEW);
 		glLoadIdentity();
-		pos = pos + (up * (train_height / 2));
+		pos = pos + (up * (carHeight / 2));
 
 
 		gluLookAt(pos.x, pos.y, pos.z,
@@ -358,15 +526,15 @@ setProjection()
 //
 // * this draws all of the stuff in the world
 //
-//	NOTE: if you're drawing shadows, DO NOT set colors (otherwise, you get 
-//       colored shadows). this gets called twice per draw 
-//       -- once for the objects, once for the shadows
+//	NOTE: if you're drawing shadows, DO NOT set colors (there's nowhere
+//       for them to go). this gets called twice per draw 
+//       -- once into the shadow map, once for the objects
 //########################################################################
 // TODO: 
 // if you have other objects in the world, make sure to draw them
 //########################################################################
 //========================================================================
-void TrainView::drawStuff(bool doingShadows)
+void TrainView::drawStuff(bool doingShadows, const IdBuffer* ids)
 {
 	// Draw the control points
 	// don't draw the control points if you're driving 
@@ -381,7 +549,9 @@ void TrainView::drawStuff(bool doingShadows)
 				else
 					glColor3ub(240, 240, 30);
 			}
-			m_pTrack->points[i].draw();
+			if (ids)
+				ids->setObject(PICK_CONTROL_POINT, (int)i, (float)i);
+			drawControlPoint(m_pTrack->points[i]);
 		}
 	}
 	// draw the track
@@ -390,133 +560,12 @@ void TrainView::drawStuff(bool doingShadows)
 	// call your own track drawing code
 	//####################################################################
 
-	for (size_t i = 0; i < m_pTrack->points.size(); ++i)
-	{
-		// pos
-		Pnt3f cp_pos_p1;
-		Pnt3f cp_pos_p2;
-
-		//dir
-		Pnt3f cp_dir;
-
-		// orient
-		Pnt3f cp_orient_p1;
-		Pnt3f cp_orient_p2;
-		float percent = 1.0f / DIVIDE_LINE;
-		float t = 0;
-
-		for (size_t j = 0; j < DIVIDE_LINE; j++)
-		{
-			getPnt3f(percent * (j + 1) + i, cp_pos_p2, cp_dir, cp_orient_p2);
-			getPnt3f(percent * j + i, cp_pos_p1, cp_dir, cp_orient_p1);
-
-			glLineWidth(3);
-			glBegin(GL_LINES);
-			if (!doingShadows)
-				glColor3ub(32, 32, 64);
-			glVertex3f(cp_pos_p1.x, cp_pos_p1.y, cp_pos_p1.z);
-			glVertex3f(cp_pos_p2.x, cp_pos_p2.y, cp_pos_p2.z);
-			glEnd();
-			glLineWidth(1);
-
-			// cross
-			Pnt3f cross_t = (cp_dir)*cp_orient_p1;
-			cross_t.normalize();
-			cross_t = cross_t * 2.5f;
-
-			glBegin(GL_LINES);
-			glVertex3f(cp_pos_p1.x + cross_t.x, cp_pos_p1.y + cross_t.y, cp_pos_p1.z + cross_t.z);
-			glVertex3f(cp_pos_p2.x + cross_t.x, cp_pos_p2.y + cross_t.y, cp_pos_p2.z + cross_t.z);
-			glVertex3f(cp_pos_p1.x - cross_t.x, cp_pos_p1.y - cross_t.y, cp_pos_p1.z - cross_t.z);
-			glVertex3f(cp_pos_p2.x - cross_t.x, cp_pos_p2.y - cross_t.y, cp_pos_p2.z - cross_t.z);
-			glEnd();
-			glLineWidth(1);
-
-			if (!doingShadows)
-				glColor3ub(255, 255, 255);
-			//break;
-		}
-		for (size_t j = 0; j < DIVIDE_LINE; j++)
-		{
-			getPnt3f(percent * j + i, cp_pos_p1, cp_dir, cp_orient_p1);
-			Pnt3f u = cp_dir;
-			Pnt3f w = u * cp_orient_p1;
-			w.normalize();
-			Pnt3f v = w * u;
-			v.normalize();
-
-
-			glMatrixMode(GL_MODELVIEW);
-			glPushMatrix();
-			glTranslatef(cp_pos_p1.x, cp_pos_p1.y, cp_pos_p1.z);
-
-			float rotation[16] = {
-									u.x, u.y, u.z, 0.0,
-									v.x, v.y, v.z, 0.0,
-									w.x, w.y, w.z, 0.0,
-									0.0, 0.0, 0.0, 1.0
-			};
-
-			glMultMatrixf(rotation);
-
-			glBegin(GL_QUADS);
-
-			float C1 = 0.75, C2 = 3;
-
-			if (!doingShadows)
-				glColor3ub(255, 100, 0);
-			glNormal3f(0, -1, 0); //Bottom
-			glVertex3f(-C1, -C1, -C2);
-			glVertex3f(C1, -C1, -C2);
-			glVertex3f(C1, -C1, C2);
-			glVertex3f(-C1, -C1, C2);
-
-			if (!doingShadows)
-				glColor3ub(0, 200, 255);
-			glNormal3f(0, 1, 0); //Up
-			glVertex3f(-C1, C1, -C2);
-			glVertex3f(C1, C1, -C2);
-			glVertex3f(C1, C1, C2);
-			glVertex3f(-C1, C1, C2);
-
-			if (!doingShadows)
-				glColor3ub(255, 255, 255);
-			glNormal3f(-1, 0, 0); //Left
-			glVertex3f(-C1, C1, -C2);
-			glVertex3f(-C1, C1, C2);
-			glVertex3f(-C1, -C1, C2);
-			glVertex3f(-C1, -C1, -C2);
-
-			if (!doingShadows)
-				glColor3ub(255, 255, 255);
-			glNormal3f(1, 0, 0); //Right
-			glVertex3f(C1, C1, -C2);
-			glVertex3f(C1, C1, C2);
-			glVertex3f(C1, -C1, C2);
-			glVertex3f(C1, -C1, -C2);
-
-			if (!doingShadows)
-				glColor3ub(255, 255, 255);
-			glNormal3f(0, 0, 1); //Front
-			glVertex3f(-C1, C1, C2);
-			glVertex3f(C1, C1, C2);
-			glVertex3f(C1, -C1, C2);
-			glVertex3f(-C1, -C1, C2);
-
-			if (!doingShadows)
-				glColor3ub(255, 255, 255);
-			glNormal3f(0, 0, -1); //Behind
-			glVertex3f(-C1, C1, -C2);
-			glVertex3f(C1, C1, -C2);
-			glVertex3f(C1, -C1, -C2);
-			glVertex3f(-C1, -C1, -C2);
-
-
-			glEnd();
-			glPopMatrix();
-		}
-		//break;
-	}
+	// the rails and ties live in a vertex buffer (see draw() for where
+	// it gets brought up to date)
+	if (ids)
+		trackMesh.drawIds(*ids);
+	else
+		trackMesh.draw(doingShadows, &shadowMap);
 
 	// draw the train
 	//####################################################################
@@ -524,85 +573,11 @@ void TrainView::drawStuff(bool doingShadows)
 	//	call your own train drawing code
 	//####################################################################
 
-	if (!this->tw->trainCam->value())
-	{
-		Pnt3f train_pos, train_dir, train_orient;
-		getPnt3f(this->t_time, train_pos, train_dir, train_orient);
-		Pnt3f u = train_dir;
-		Pnt3f w = u * train_orient;
-		w.normalize();
-		Pnt3f v = w * u;
-		v.normalize();
-
-
-		glMatrixMode(GL_MODELVIEW);
-		glPushMatrix();
-		glTranslatef(train_pos.x, train_pos.y, train_pos.z);
-
-		float rotation[16] = {
-								u.x, u.y, u.z, 0.0,
-								v.x, v.y, v.z, 0.0,
-								w.x, w.y, w.z, 0.0,
-								0.0, 0.0, 0.0, 1.0
-		};
-
-		glMultMatrixf(rotation);
-		glRotatef(90, 0, -1, 0);
-		glTranslatef(0, 0.75, 0);
-		glBegin(GL_QUADS);
-
-		if (!doingShadows)
-			glColor3ub(255, 255, 255);
-		glNormal3f(0, -1, 0); //Bottom
-		glVertex3f(-train_width / 2, 0, -train_length / 2);
-		glVertex3f(train_width / 2, 0, -train_length / 2);
-		glVertex3f(train_width / 2, 0, train_length / 2);
-		glVertex3f(-train_width / 2, 0, train_length / 2);
-
-		if (!doingShadows)
-			glColor3ub(0, 0, 0);
-		glNormal3f(0, 1, 0); //top
-		glVertex3f(-train_width / 2, train_height, -train_length / 2);
-		glVertex3f(train_width / 2, train_height, -train_length / 2);
-		glVertex3f(train_width / 2, train_height, train_length / 2);
-		glVertex3f(-train_width / 2, train_height, train_length / 2);
-
-		if (!doingShadows)
-			glColor3ub(255, 0, 0);
-		glNormal3f(-1, 0, 0); //Left
-		glVertex3f(-train_width / 2, train_height, -train_length / 2);
-		glVertex3f(-train_width / 2, train_height, train_length / 2);
-		glVertex3f(-train_width / 2, 0, train_length / 2);
-		glVertex3f(-train_width / 2, 0, -train_length / 2);
-
-		if (!doingShadows)
-			glColor3ub(255, 0, 0);
-		glNormal3f(1, 0, 0); //Right
-		glVertex3f(train_width / 2, train_height, -train_length / 2);
-		glVertex3f(train_width / 2, train_height, train_length / 2);
-		glVertex3f(train_width / 2, 0, train_length / 2);
-		glVertex3f(train_width / 2, 0, -train_length / 2);
-
-		if (!doingShadows)
-			glColor3ub(0, 255, 0);
-		glNormal3f(0, 0, 1); //Front
-		glVertex3f(-train_width / 2, train_height, -train_length / 2);
-		glVertex3f(train_width / 2, train_height, -train_length / 2);
-		glVertex3f(train_width / 2, 0, -train_length / 2);
-		glVertex3f(-train_width / 2, 0, -train_length / 2);
-
-		if (!doingShadows)
-			glColor3ub(0, 0, 255);
-		glNormal3f(0, 0, -1); //Behind
-		glVertex3f(-train_width / 2, train_height, train_length / 2);
-		glVertex3f(train_width / 2, train_height, train_length / 2);
-		glVertex3f(train_width / 2, 0, train_length / 2);
-		glVertex3f(-train_width / 2, 0, train_length / 2);
-
-
-		glEnd();
-		glPopMatrix();
-	}
+	// every car in one go (see updateCars)
+	if (ids)
+		cars.drawIds(*ids, PICK_TRAIN, firstCarDrawn);
+	else
+		cars.draw(&shadowMap);
 }
 
 
@@ -626,182 +601,157 @@ void TrainView::doPick()
 	// active window
 	make_current();
 
-	// where is the mouse?
-	int mx = Fl::event_x();
-	int my = Fl::event_y();
-
-	// get the viewport - most reliable way to turn mouse coords into GL coords
-	int viewport[4];
-	glGetIntegerv(GL_VIEWPORT, viewport);
-
-	// Set up the pick matrix on the stack - remember, FlTk is
-	// upside down!
+	// the mouse line goes through the camera's matrices
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
-	gluPickMatrix((double)mx, (double)(viewport[3] - my),
-		5, 5, viewport);
-
-	// now set up the projection
 	setProjection();
 
-	// now draw the objects - but really only see what we hit
-	GLuint buf[100];
-	glSelectBuffer(100, buf);
-	glRenderMode(GL_SELECT);
-	glInitNames();
-	glPushName(0);
-
-	// draw the cubes, loading the names as we go
-	for (size_t i = 0; i < m_pTrack->points.size(); ++i) {
-		glLoadName((GLuint)(i + 1));
-		m_pTrack->points[i].draw();
+	double r1x, r1y, r1z, r2x, r2y, r2z;
+	if (!getMouseLine(r1x, r1y, r1z, r2x, r2y, r2z)) {
+		selectedCube = -1;
+		return;
 	}
 
-	// go back to drawing mode, and see how picking did
-	int hits = glRenderMode(GL_RENDER);
-	if (hits) {
-		// warning; this just grabs the first object hit - if there
-		// are multiple objects, you really want to pick the closest
-		// one - see the OpenGL manual 
-		// remember: we load names that are one more than the index
-		selectedCube = buf[3] - 1;
-	}
-	else // nothing hit, nothing selected
-		selectedCube = -1;
+	// the two points are a quarter and three quarters of the way into
+	// the depth range - backing up half of the way between them gets to
+	// the near plane (orthographic), or about the eye (perspective)
+	Pnt3f p1((float)r1x, (float)r1y, (float)r1z);
+	Pnt3f p2((float)r2x, (float)r2y, (float)r2z);
+	Pnt3f dir = p2 - p1;
+
+	// the closest control point along the ray (-1 if it misses them all)
+	selectedCube = m_pTrack->pickIndex().pick(p1 - dir * 0.5f, dir);
 
 	printf("Selected Cube %d\n", selectedCube);
 }
 
-void TrainView::getPnt3f(float t, Pnt3f& pos, Pnt3f& dir, Pnt3f& up)
+//************************************************************************
+//
+// * ask for an ID buffer pick - FlTk is upside down, GL isn't
+//========================================================================
+void TrainView::
+queuePick(int mx, int my)
+//========================================================================
 {
-	while (t >= m_pTrack->points.size())
-	{
-		t -= m_pTrack->points.size();
-	}
-	if (this->tw->splineBrowser->selected(1))
-	{
-		for (int i = 0; i < this->m_pTrack->points.size(); i++)
-		{
-			if (t >= i && t < i + 1)
-			{
-				t -= i;
-				pos = t * m_pTrack->points[(i + 1) % m_pTrack->points.size()].pos + (1 - t) * m_pTrack->points[i].pos;
-				dir = m_pTrack->points[(i + 1) % m_pTrack->points.size()].pos - m_pTrack->points[i].pos;
-				dir.normalize();
-				up = t * m_pTrack->points[(i + 1) % m_pTrack->points.size()].orient + (1 - t) * m_pTrack->points[i].orient;
-				up.normalize();
-				break;
-			}
-		}
-	}
-	else if (this->tw->splineBrowser->selected(2))
-	{
-		const float M_matrix[4][4] = {
-										-1.0,  2.0, -1.0,  0.0,
-										 3.0, -5.0,  0.0,  2.0,
-										-3.0,  4.0,  1.0,  0.0,
-										 1.0,  -1.0,  0.0,  0.0
-		};
+	pickQueued = true;
+	pickX = mx;
+	pickY = h() - 1 - my;
+	damage(1);
+}
 
-		for (int i = 0; i < this->m_pTrack->points.size(); i++)
-		{
-			if (t >= i && t < i + 1)
-			{
-				t -= i;
-				const float T[4] = { t * t * t,t * t,t,1.0 };
-				const float DT[4] = { 3.0 * t * t,2.0 * t,1.0,0 };
-				Pnt3f G[4];
-				if (i == 0)
-				{
-					G[0] = m_pTrack->points[m_pTrack->points.size() - 1].pos;
-				}
-				else
-				{
-					G[0] = m_pTrack->points[i - 1].pos;
-				}
-				G[1] = m_pTrack->points[(i) % m_pTrack->points.size()].pos;
-				G[2] = m_pTrack->points[(i + 1) % m_pTrack->points.size()].pos;
-				G[3] = m_pTrack->points[(i + 2) % m_pTrack->points.size()].pos;
-				pos = Matrix_Multiple(M_matrix, T, G, 0.5);
-				dir = Matrix_Multiple(M_matrix, DT, G, 0.5);
-				dir.normalize();
-				G[0] = m_pTrack->points[i].orient;
-				G[1] = m_pTrack->points[(i + 1) % m_pTrack->points.size()].orient;
-				G[2] = m_pTrack->points[(i + 2) % m_pTrack->points.size()].orient;
-				G[3] = m_pTrack->points[(i + 3) % m_pTrack->points.size()].orient;
-				up = Matrix_Multiple(M_matrix, T, G, 0.5);
-				up.normalize();
-			}
-		}
-	}
-	else if (this->tw->splineBrowser->selected(3))
-	{
-		const float M_matrix[4][4] = {
-										-1.0,  3.0, -3.0,  1.0,
-										 3.0, -6.0,  0.0,  4.0,
-										-3.0,  3.0,  3.0,  1.0,
-										 1.0,  0.0,  0.0,  0.0
-		};
+//************************************************************************
+//
+// * the ID buffer has answered: a control point gets selected, and a
+//   click on the track (or a tie) puts a new point there
+//========================================================================
+void TrainView::
+picked(const PickResult& pick)
+//========================================================================
+{
+	if (pick.kind > PICK_TRAIN)
+		return;
 
-		for (int i = 0; i < this->m_pTrack->points.size(); i++)
-		{
-			if (t >= i && t < i + 1)
-			{
-				t -= i;
-				const float T[4] = { t * t * t,t * t,t,1.0 };
-				const float DT[4] = { 3.0 * t * t,2.0 * t,1.0,0 };
-				Pnt3f G[4];
-				if (i == 0)
-				{
-					G[0] = m_pTrack->points[m_pTrack->points.size() - 1].pos;
-				}
-				else
-				{
-					G[0] = m_pTrack->points[i - 1].pos;
-				}
-				G[1] = m_pTrack->points[(i) % m_pTrack->points.size()].pos;
-				G[2] = m_pTrack->points[(i + 1) % m_pTrack->points.size()].pos;
-				G[3] = m_pTrack->points[(i + 2) % m_pTrack->points.size()].pos;
-				pos = Matrix_Multiple(M_matrix, T, G, 1.0f / 6.0f);
-				dir = Matrix_Multiple(M_matrix, DT, G, 1.0f / 6.0f);
-				dir.normalize();
-				if (i == 0)
-				{
-					G[0] = m_pTrack->points[m_pTrack->points.size() - 1].orient;
-				}
-				else
-				{
-					G[0] = m_pTrack->points[i - 1].orient;
-				}
-				G[1] = m_pTrack->points[(i + 1) % m_pTrack->points.size()].orient;
-				G[2] = m_pTrack->points[(i + 2) % m_pTrack->points.size()].orient;
-				G[3] = m_pTrack->points[(i + 3) % m_pTrack->points.size()].orient;
-				up = Matrix_Multiple(M_matrix, T, G, 1.0f / 6.0f);
-				up.normalize();
-			}
-		}
+	switch (pick.kind) {
+	case PICK_CONTROL_POINT:
+		selectedCube = pick.index;
+		break;
+	case PICK_TRACK:
+	case PICK_TIE:
+		insertPoint(pick.t);
+		break;
+	default:
+		break;
 	}
+	damage(1);
+}
 
-	return;
+//************************************************************************
+//
+// * the new point goes between the two ends of the segment t is in, on
+//   the track, with the orientation blended between theirs
+//========================================================================
+void TrainView::
+insertPoint(float t)
+//========================================================================
+{
+	size_t n = m_pTrack->points.size();
+	if (!n)
+		return;
+
+	t = fmodf(t, (float)n);
+	if (t < 0)
+		t += (float)n;
+	size_t i = std::min((size_t)t, n - 1);
+	float f = t - (float)i;
+
+	Pnt3f pos, dir, up;
+	getPnt3f(t, pos, dir, up);
+	Pnt3f orient = m_pTrack->points[i].orient * (1 - f) +
+				   m_pTrack->points[(i + 1) % n].orient * f;
+	orient.normalize();
+
+	m_pTrack->insertPoint(i + 1, ControlPoint(pos, orient));
+	selectedCube = (int)(i + 1);
 }
 
-Pnt3f Matrix_Multiple(const float matrix[4][4], const float T_var[4], Pnt3f* g, float r)
+//************************************************************************
+//
+// * which spline the browser has selected
+//========================================================================
+SplineType TrainView::
+splineType()
+//========================================================================
 {
-	Pnt3f temp;
-	float result[4] = { 0 };
+	if (tw->splineBrowser->selected(1))
+		return SPLINE_LINEAR;
+	if (tw->splineBrowser->selected(3))
+		return SPLINE_BSPLINE;
+	return SPLINE_CARDINAL;
+}
 
-	for (int i = 0; i < 4; i++)
-	{
-		for (int j = 0; j < 4; j++)
-		{
-			result[i] += (matrix[i][j] * T_var[j]);
-		}
-	}
+//************************************************************************
+//
+// * position, direction and up vector of the track at parameter t
+//   (the coefficients are cached by the track, so this is just a cubic)
+//========================================================================
+void TrainView::
+getPnt3f(float t, Pnt3f& pos, Pnt3f& dir, Pnt3f& up)
+//========================================================================
+{
+	m_pTrack->spline(splineType()).eval(t, pos, dir, up);
+}
 
-	for (int i = 0; i < 4; i++)
-	{
-		temp = temp + (g[i] * result[i]);
-	}
+//************************************************************************
+//
+// * where the train is at parameter t, and which way it faces - the
+//   frame comes out of the track's frame table, so the train turns the
+//   same way the ties do
+//========================================================================
+void TrainView::
+trainFrame(float t, Pnt3f& pos, Pnt3f& u, Pnt3f& v, Pnt3f& w)
+//========================================================================
+{
+	SplineType type = splineType();
+	Pnt3f dir, up;
+	m_pTrack->spline(type).eval(t, pos, dir, up);
+	m_pTrack->frames(type).frameAt(t, u, v, w);
+}
+
+//************************************************************************
+//
+// * one box per car, from where the trains are now. the simulation has
+//   worked the frames out already (on the track as it had it - if that
+//   just changed, a snapshot on the new one is on its way), so they're
+//   just sent again every frame - they all move
+//========================================================================
+void TrainView::
+updateCars()
+//========================================================================
+{
+	size_t numCars = snapshot->cars.size();
 
-	return temp * r;
-}
\ No newline at end of file
+	// don't draw the car the camera is in
+	firstCarDrawn = (tw->trainCam->value() && numCars > 0) ? 1 : 0;
+
+	cars.upload(numCars ? &snapshot->cars[firstCarDrawn] : 0, numCars - firstCarDrawn);
+}
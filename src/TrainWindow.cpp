@@ -16,9 +16,9 @@
 						You might want to modify this class to add new widgets
 						for controlling	your train
 
-						This takes care of lots of things - including installing
-						itself into the FlTk "idle" loop so that we get periodic
-						updates (if we're running the train).
+						This takes care of lots of things - including running
+						a FlTk timer so that we get periodic updates (if we're
+						running the train).
 
 
 	 Platform:    Visio Studio.Net 2003/2005
@@ -29,7 +29,8 @@
 #include <FL/Fl_Box.h>
 
 // for using the real time clock
-#include <time.h>
+#include <algorithm>
+#include <math.h>
 
 #include "TrainWindow.H"
 #include "TrainView.H"
@@ -44,7 +45,8 @@
 //========================================================================
 TrainWindow::
 TrainWindow(const int x, const int y)
-	: Fl_Double_Window(x, y, 800, 600, "Train and Roller Coaster")
+	: Fl_Double_Window(x, y, 800, 600, "Train and Roller Coaster"),
+	sentAny(false), sentType(SPLINE_LINEAR), sentVersion(0)
 	//========================================================================
 {
 	// make all of the widgets
@@ -63,6 +65,7 @@ TrainWindow(const int x, const int y)
 
 		runButton = new Fl_Button(605, pty, 60, 20, "Run");
 		togglify(runButton);
+		runButton->callback((Fl_Callback*)runButtonCB, this);
 
 		Fl_Button* fb = new Fl_Button(700, pty, 25, 20, "@>>");
 		fb->callback((Fl_Callback*)forwCB, this);
@@ -78,6 +81,7 @@ TrainWindow(const int x, const int y)
 		speed->value(2);
 		speed->align(FL_ALIGN_LEFT);
 		speed->type(FL_HORIZONTAL);
+		speed->callback((Fl_Callback*)damageCB, this);
 
 		pty += 30;
 
@@ -143,6 +147,66 @@ TrainWindow(const int x, const int y)
 
 		pty += 30;
 
+		// how often to redraw while the train runs
+		frameRate = new Fl_Value_Slider(655, pty, 140, 20, "fps");
+		frameRate->range(10, 120);
+		frameRate->step(1);
+		frameRate->value(60);
+		frameRate->align(FL_ALIGN_LEFT);
+		frameRate->type(FL_HORIZONTAL);
+		frameRate->callback((Fl_Callback*)damageCB, this);
+
+		pty += 30;
+
+		// how round the cardinal spline is
+		tension = new Fl_Value_Slider(655, pty, 140, 20, "tension");
+		tension->range(0, 1);
+		tension->value(m_Track.tension);
+		tension->align(FL_ALIGN_LEFT);
+		tension->type(FL_HORIZONTAL);
+		tension->callback((Fl_Callback*)tensionCB, this);
+
+		pty += 30;
+
+		// how many trains, and how long they are
+		numTrains = new Fl_Value_Slider(655, pty, 140, 20, "trains");
+		numTrains->range(1, 50);
+		numTrains->step(1);
+		numTrains->value(1);
+		numTrains->align(FL_ALIGN_LEFT);
+		numTrains->type(FL_HORIZONTAL);
+		numTrains->callback((Fl_Callback*)trainsCB, this);
+
+		pty += 25;
+		carsPerTrain = new Fl_Value_Slider(655, pty, 140, 20, "cars");
+		carsPerTrain->range(1, 100);
+		carsPerTrain->step(1);
+		carsPerTrain->value(1);
+		carsPerTrain->align(FL_ALIGN_LEFT);
+		carsPerTrain->type(FL_HORIZONTAL);
+		carsPerTrain->callback((Fl_Callback*)trainsCB, this);
+
+		pty += 30;
+
+		// let gravity run the trains (instead of the speed), with the
+		// speed as the slowest they go up the hills
+		physics = new Fl_Button(605, pty, 60, 20, "Physics");
+		togglify(physics);
+		lift = new Fl_Button(670, pty, 60, 20, "Lift");
+		togglify(lift, 1);
+
+		pty += 25;
+		// how many times faster than real time the trains run
+		timeScale = new Fl_Value_Slider(655, pty, 140, 20, "time x");
+		timeScale->range(1, 1000);
+		timeScale->step(1);
+		timeScale->value(1);
+		timeScale->align(FL_ALIGN_LEFT);
+		timeScale->type(FL_HORIZONTAL);
+		timeScale->callback((Fl_Callback*)damageCB, this);
+
+		pty += 30;
+
 		// TODO: add widgets for all of your fancier features here
 #ifdef EXAMPLE_SOLUTION
 		makeExampleWidgets(this, pty);
@@ -156,8 +220,9 @@ TrainWindow(const int x, const int y)
 	}
 	end();	// done adding to this widget
 
-	// set up callback on idle
-	Fl::add_idle((void (*)(void*))runButtonCB, this);
+	// hand the simulation the track, and let it go
+	syncSimulation();
+	simulation.start(simulationCB, this);
 }
 
 //************************************************************************
@@ -184,40 +249,76 @@ damageMe()
 {
 	if (trainView->selectedCube >= ((int)m_Track.points.size()))
 		trainView->selectedCube = 0;
+	syncSimulation();
 	trainView->damage(1);
 }
 
 //************************************************************************
 //
-// * This will get called (approximately) 30 times per second
-//   if the run button is pressed
+// * tell the simulation what the widgets say, and what the track looks
+//   like - but only what changed, since every new thing it gets makes it
+//   publish (and us draw) again
 //========================================================================
-void TrainWindow::advanceTrain(float dir)
+void TrainWindow::
+syncSimulation()
 //========================================================================
 {
-	//#####################################################################
-	// TODO: make this work for your train
-	//#####################################################################
+	SimulationSettings now;
+	now.speed = (float)speed->value();
+	now.arcLength = arcLength->value() != 0;
+	now.physics = physics->value() != 0;
+	now.lift = lift->value() != 0;
+	now.timeScale = (float)timeScale->value();
+	now.frameRate = (float)frameRate->value();
+
+	if (!sentAny || now.speed != sent.speed || now.arcLength != sent.arcLength ||
+		now.physics != sent.physics || now.lift != sent.lift ||
+		now.timeScale != sent.timeScale || now.frameRate != sent.frameRate)
+		simulation.setSettings(now);
+
+	// the simulation builds what it needs from the snapshot itself
+	SplineType type = trainView->splineType();
+	const TrackSnapshot& track = m_Track.snapshot();
+	if (!sentAny || type != sentType || track.version() != sentVersion) {
+		simulation.setTrack(track, type);
+		sentType = type;
+		sentVersion = track.version();
+	}
 
-	trainView->t_time += dir * ((float)speed->value() * .05f);
-	float nct = static_cast<float>(this->m_Track.points.size());
+	sent = now;
+	sentAny = true;
+}
 
-	if (trainView->t_time > nct) 	trainView->t_time -= nct;
-	if (trainView->t_time < 0) 	trainView->t_time += nct;
-#ifdef EXAMPLE_SOLUTION
-	// note - we give a little bit more example code here than normal,
-	// so you can see how this works
+//************************************************************************
+//
+// * Run was pushed - the simulation starts ticking from now
+//========================================================================
+void TrainWindow::
+startRunning()
+//========================================================================
+{
+	syncSimulation();
+	simulation.setRunning(true);
+}
 
-	if (arcLength->value()) {
-		float vel = ew.physics->value() ? physicsSpeed(this) : dir * (float)speed->value();
-		world.trainU += arclenVtoV(world.trainU, vel, this);
-	}
-	else {
-		world.trainU += dir * ((float)speed->value() * .1f);
-	}
+//************************************************************************
+//
+// * Run was let go - the simulation sleeps until something else happens
+//========================================================================
+void TrainWindow::
+stopRunning()
+//========================================================================
+{
+	simulation.setRunning(false);
+}
 
-	float nct = static_cast<float>(world.points.size());
-	if (world.trainU > nct) world.trainU -= nct;
-	if (world.trainU < 0) world.trainU += nct;
-#endif
-}
\ No newline at end of file
+//************************************************************************
+//
+// * Move the train once (the simulation does it, the next time it wakes)
+//========================================================================
+void TrainWindow::advanceTrain(float dir, float dt)
+//========================================================================
+{
+	syncSimulation();
+	simulation.step(dir, dt);
+}
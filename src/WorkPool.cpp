@@ -0,0 +1,180 @@
+/************************************************************************
+     File:        WorkPool.cpp
+
+     Comment:     Spreading a loop over all of the cores
+
+						See WorkPool.H.
+
+     Platform:    Visio Studio.Net 2003/2005
+
+*************************************************************************/
+
+#include <algorithm>
+
+#include "WorkPool.H"
+
+//****************************************************************************
+//
+// * Constructor - the extra threads start right away, and sleep until
+//   there's something to do
+//============================================================================
+WorkPool::
+WorkPool(int threads)
+	: job(0), remaining(0), generation(0), quit(false)
+//============================================================================
+{
+	if (threads <= 0)
+		threads = std::max((int)std::thread::hardware_concurrency(), 1);
+
+	for (int i = 0; i < threads; i++)
+		queues.push_back(std::unique_ptr<Queue>(new Queue));
+	for (int i = 1; i < threads; i++)
+		this->threads.push_back(std::thread(&WorkPool::work, this, i));
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+WorkPool::
+~WorkPool()
+//============================================================================
+{
+	{
+		std::lock_guard<std::mutex> held(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+//****************************************************************************
+//
+// *
+//============================================================================
+WorkPool& WorkPool::
+shared()
+//============================================================================
+{
+	static WorkPool pool;
+	return pool;
+}
+
+//****************************************************************************
+//
+// * deal the chunks out, wake everyone up, do our share (and whatever we
+//   can steal), then wait for the last of them
+//============================================================================
+void WorkPool::
+run(size_t count, size_t chunk, const std::function<void(size_t, size_t)>& job)
+//============================================================================
+{
+	if (!count)
+		return;
+	chunk = std::max(chunk, (size_t)1);
+	size_t numChunks = (count + chunk - 1) / chunk;
+	if (queues.size() == 1 || numChunks == 1) {
+		job(0, count);
+		return;
+	}
+
+	std::lock_guard<std::mutex> one(running);
+	this->job = &job;
+	remaining.store(numChunks);
+
+	// an even run of chunks each - side by side ones, so a thread that
+	// doesn't have to steal works through one part of the output
+	size_t q = queues.size();
+	for (size_t t = 0; t < q; t++) {
+		std::lock_guard<std::mutex> held(queues[t]->lock);
+		for (size_t c = numChunks * t / q; c < numChunks * (t + 1) / q; c++)
+			queues[t]->chunks.push_back(std::make_pair(c * chunk, std::min(count, (c + 1) * chunk)));
+	}
+
+	{
+		std::lock_guard<std::mutex> held(lock);
+		generation++;
+	}
+	wake.notify_all();
+
+	help(0);
+
+	std::unique_lock<std::mutex> held(lock);
+	finished.wait(held, [this] { return remaining.load() == 0; });
+	this->job = 0;
+}
+
+//****************************************************************************
+//
+// * an extra thread. it can sleep through a whole run (the others do its
+//   chunks) - that's fine, it just waits for the next one
+//============================================================================
+void WorkPool::
+work(int me)
+//============================================================================
+{
+	unsigned long seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> held(lock);
+			wake.wait(held, [this, seen] { return quit || generation != seen; });
+			if (quit)
+				return;
+			seen = generation;
+		}
+		help(me);
+	}
+}
+
+//****************************************************************************
+//
+// * the job is only looked at once a chunk is taken - the chunks were put
+//   in the queues after it was set, so the queue's lock makes sure we see
+//   it, and run() can't return (and a new run start) while we hold one
+//============================================================================
+void WorkPool::
+help(int me)
+//============================================================================
+{
+	std::pair<size_t, size_t> chunk;
+	while (take(me, chunk)) {
+		(*job)(chunk.first, chunk.second);
+		if (remaining.fetch_sub(1) == 1) {
+			std::lock_guard<std::mutex> held(lock);
+			finished.notify_all();
+		}
+	}
+}
+
+//****************************************************************************
+//
+// * our own chunks from the front, other people's from the back (the end
+//   they'd get to last)
+//============================================================================
+bool WorkPool::
+take(int me, std::pair<size_t, size_t>& chunk)
+//============================================================================
+{
+	{
+		Queue& own = *queues[me];
+		std::lock_guard<std::mutex> held(own.lock);
+		if (!own.chunks.empty()) {
+			chunk = own.chunks.front();
+			own.chunks.pop_front();
+			return true;
+		}
+	}
+
+	size_t q = queues.size();
+	for (size_t k = 1; k < q; k++) {
+		Queue& other = *queues[(me + k) % q];
+		std::lock_guard<std::mutex> held(other.lock);
+		if (!other.chunks.empty()) {
+			chunk = other.chunks.back();
+			other.chunks.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
@@ -36,6 +36,10 @@ int main(int, char**)
 {
 	printf("CS559 Train Assignment\n");
 
+	// the trains run on a thread of their own, which wakes us up to
+	// redraw (Fl::awake) - that needs FlTk's lock
+	Fl::lock();
+
 	TrainWindow tw;
 	tw.show();
 